@@ -0,0 +1,448 @@
+#define _GNU_SOURCE // для sched_getcpu()
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h> // offsetof
+#include <string.h>
+#include <sched.h>
+#include <unistd.h>
+
+#include "mpi.h"
+
+/*
+ * Сбор "Hello" от всех процессов четырьмя способами с замером времени:
+ *   any     - как prog1: процесс 0 делает ProcNum-1 приемов MPI_Recv от MPI_ANY_SOURCE
+ *   ordered - как prog2: то же, но строго по порядку рангов 1, 2, 3...
+ *   gather  - одна коллективная MPI_Gather записей фиксированного размера
+ *   gatherv - MPI_Gather чисел + MPI_Gatherv имен узлов переменной длины (меньше байт)
+ * В первых двух процесс 0 принимает сообщения по одному (O(P) последовательных приемов),
+ * коллективные операции MPI раскладывает деревом (O(log P) шагов).
+ *
+ * Перед замерами печатается размещение процессов по узлам (MPI_Comm_split_type с
+ * MPI_COMM_TYPE_SHARED): сколько процессов на узле, сколько там ядер и NUMA-узлов, к каким ядрам
+ * процессы привязаны. Переподписка и неравномерное размещение искажают все замеры, поэтому о них
+ * выводится предупреждение. --placement - еще и таблица по каждому рангу.
+ *
+ * Запуск: mpirun -np 256 ./prog3 [--mode=all|any|ordered|gather|gatherv] [--reps=20] [--quiet]
+ *                                [--placement]
+ */
+
+#define MAX_REPS 1000
+
+// Что каждый процесс сообщает о себе
+typedef struct {
+    int rank;   // ранг
+    int pid;    // идентификатор процесса ОС
+    int core;   // ядро, на котором процесс выполняется сейчас (-1, если неизвестно)
+    char host[MPI_MAX_PROCESSOR_NAME]; // имя узла
+} HelloInfo;
+
+// Способы сбора
+enum { MODE_ANY, MODE_ORDERED, MODE_GATHER, MODE_GATHERV, NUM_MODES };
+static const char *mode_names[NUM_MODES] = {"any", "ordered", "gather", "gatherv"};
+
+// Заполнение записи о себе
+static void fill_info(HelloInfo *info, int ProcRank) {
+    int len;
+    memset(info, 0, sizeof(*info));
+    info->rank = ProcRank;
+    info->pid = (int)getpid();
+    info->core = sched_getcpu();
+    MPI_Get_processor_name(info->host, &len);
+}
+
+// MPI-тип для записи HelloInfo: три int и строка
+static MPI_Datatype info_type(void) {
+    MPI_Datatype type, resized;
+    int blocklens[2] = {3, MPI_MAX_PROCESSOR_NAME};
+    MPI_Aint displs[2] = {offsetof(HelloInfo, rank), offsetof(HelloInfo, host)};
+    MPI_Datatype types[2] = {MPI_INT, MPI_CHAR};
+    MPI_Type_create_struct(2, blocklens, displs, types, &type);
+    // Экстент - ровно sizeof(HelloInfo), чтобы массив записей шел без сдвигов
+    MPI_Type_create_resized(type, 0, sizeof(HelloInfo), &resized);
+    MPI_Type_commit(&resized);
+    MPI_Type_free(&type);
+    return resized;
+}
+
+/*
+ * Сбор записей на процесс 0 выбранным способом. all (только на процессе 0) - массив на ProcNum
+ * записей, на выходе all[i] - запись процесса i (для any записи раскладываются по рангу).
+ */
+static void collect(int mode, const HelloInfo *mine, HelloInfo *all, MPI_Datatype type,
+                    int ProcRank, int ProcNum) {
+    MPI_Status Status;
+
+    if (mode == MODE_ANY || mode == MODE_ORDERED) {
+        if (ProcRank == 0) {
+            all[0] = *mine;
+            for (int i = 1; i < ProcNum; i++) {
+                HelloInfo rec;
+                // any - от кого угодно, кто успел первым; ordered - строго от процесса i.
+                // Тег - номер способа: сообщения разных способов не перепутаются
+                MPI_Recv(&rec, 1, type, mode == MODE_ANY ? MPI_ANY_SOURCE : i, mode, MPI_COMM_WORLD, &Status);
+                all[Status.MPI_SOURCE] = rec;
+            }
+        } else {
+            MPI_Send(mine, 1, type, 0, mode, MPI_COMM_WORLD);
+        }
+    } else if (mode == MODE_GATHER) {
+        // Все записи одного размера: одна коллективная операция
+        MPI_Gather(mine, 1, type, all, 1, type, 0, MPI_COMM_WORLD);
+    } else {
+        // Числа - записями фиксированного размера, имена узлов - подряд без хвостовых нулей
+        int nums[4] = {mine->rank, mine->pid, mine->core, (int)strlen(mine->host)};
+        int *all_nums = NULL, *displs = NULL, *lens = NULL;
+        char *names = NULL;
+        if (ProcRank == 0) {
+            all_nums = (int*)malloc(4 * ProcNum * sizeof(int));
+            lens = (int*)malloc(ProcNum * sizeof(int));
+            displs = (int*)malloc(ProcNum * sizeof(int));
+        }
+        MPI_Gather(nums, 4, MPI_INT, all_nums, 4, MPI_INT, 0, MPI_COMM_WORLD);
+        int total = 0;
+        if (ProcRank == 0) {
+            for (int i = 0; i < ProcNum; i++) {
+                lens[i] = all_nums[4 * i + 3];
+                displs[i] = total;
+                total += lens[i];
+            }
+            names = (char*)malloc(total > 0 ? total : 1);
+        }
+        MPI_Gatherv(mine->host, nums[3], MPI_CHAR, names, lens, displs, MPI_CHAR, 0, MPI_COMM_WORLD);
+        if (ProcRank == 0) {
+            for (int i = 0; i < ProcNum; i++) {
+                all[i].rank = all_nums[4 * i];
+                all[i].pid = all_nums[4 * i + 1];
+                all[i].core = all_nums[4 * i + 2];
+                memcpy(all[i].host, names + displs[i], lens[i]);
+                all[i].host[lens[i]] = '\0';
+            }
+            free(all_nums);
+            free(lens);
+            free(displs);
+            free(names);
+        }
+    }
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+// Где процесс запущен и к чему привязан
+typedef struct {
+    int node;       // номер узла: по порядку групп MPI_COMM_TYPE_SHARED
+    int local_rank; // ранг внутри узла
+    int local_size; // процессов на узле
+    int core;       // текущее ядро (-1, если неизвестно)
+    int numa;       // текущий NUMA-узел (-1, если неизвестно)
+    int ncpus;      // ядер на узле (онлайн)
+    int nnuma;      // NUMA-узлов на узле
+    int nallowed;   // ядер в маске привязки процесса
+    cpu_set_t mask; // маска привязки (sched_getaffinity)
+    char host[MPI_MAX_PROCESSOR_NAME];
+} Placement;
+
+// Число элементов в списке вида "0-3,8,10-11" (формат файлов /sys/devices/system/*/online)
+static int count_list(const char *s) {
+    int n = 0;
+    while (*s) {
+        char *end;
+        long a = strtol(s, &end, 10), b = a;
+        if (end == s) break;
+        if (*end == '-') b = strtol(end + 1, &end, 10);
+        n += (int)(b - a + 1);
+        s = (*end == ',') ? end + 1 : end;
+    }
+    return n;
+}
+
+// Число NUMA-узлов машины; 1, если sysfs недоступна
+static int numa_nodes(void) {
+    char buf[256] = "";
+    FILE *f = fopen("/sys/devices/system/node/online", "r");
+    if (f == NULL) return 1;
+    if (fgets(buf, sizeof(buf), f) == NULL) buf[0] = '\0';
+    fclose(f);
+    int n = count_list(buf);
+    return n > 0 ? n : 1;
+}
+
+// Сжатая запись возрастающего списка чисел: 0-3,8,10-11. Длинный список обрезается многоточием
+static void format_ranges(const int *v, int n, char *buf, size_t size) {
+    size_t len = 0;
+    buf[0] = '\0';
+    for (int i = 0; i < n; ) {
+        int j = i;
+        while (j + 1 < n && v[j + 1] == v[j] + 1) j++;
+        char item[32];
+        if (j == i) snprintf(item, sizeof(item), "%s%d", i ? "," : "", v[i]);
+        else snprintf(item, sizeof(item), "%s%d-%d", i ? "," : "", v[i], v[j]);
+        if (len + strlen(item) + 4 >= size) {
+            snprintf(buf + len, size - len, "...");
+            return;
+        }
+        len += snprintf(buf + len, size - len, "%s", item);
+        i = j + 1;
+    }
+}
+
+static void format_mask(const cpu_set_t *mask, char *buf, size_t size) {
+    int cpus[CPU_SETSIZE], n = 0;
+    for (int c = 0; c < CPU_SETSIZE; c++)
+        if (CPU_ISSET(c, mask)) cpus[n++] = c;
+    format_ranges(cpus, n, buf, size);
+}
+
+// Сведения о своем размещении. Номер узла - ранг лидера узла среди лидеров всех узлов
+static void probe_placement(Placement *pl, int ProcRank) {
+    MPI_Comm node_comm, leaders;
+    int len;
+    unsigned cpu, numa;
+
+    memset(pl, 0, sizeof(*pl));
+    MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, ProcRank, MPI_INFO_NULL, &node_comm);
+    MPI_Comm_rank(node_comm, &pl->local_rank);
+    MPI_Comm_size(node_comm, &pl->local_size);
+    MPI_Comm_split(MPI_COMM_WORLD, pl->local_rank == 0 ? 0 : MPI_UNDEFINED, ProcRank, &leaders);
+    if (leaders != MPI_COMM_NULL) {
+        MPI_Comm_rank(leaders, &pl->node);
+        MPI_Comm_free(&leaders);
+    }
+    MPI_Bcast(&pl->node, 1, MPI_INT, 0, node_comm);
+    MPI_Comm_free(&node_comm);
+
+    if (getcpu(&cpu, &numa) == 0) {
+        pl->core = (int)cpu;
+        pl->numa = (int)numa;
+    } else {
+        pl->core = pl->numa = -1;
+    }
+    pl->ncpus = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    pl->nnuma = numa_nodes();
+    if (sched_getaffinity(0, sizeof(pl->mask), &pl->mask) == 0) {
+        pl->nallowed = CPU_COUNT(&pl->mask);
+    } else {
+        // Маска неизвестна: считаем, что процессу доступны все ядра
+        CPU_ZERO(&pl->mask);
+        for (int c = 0; c < pl->ncpus && c < CPU_SETSIZE; c++) CPU_SET(c, &pl->mask);
+        pl->nallowed = pl->ncpus;
+    }
+    MPI_Get_processor_name(pl->host, &len);
+}
+
+/*
+ * Таблица размещения на процессе 0: строка на узел, по желанию строка на ранг, и предупреждения
+ * о том, что исказит замеры. Записи пересылаются байтами - все процессы одной архитектуры.
+ */
+static void placement_report(int ProcRank, int ProcNum, int per_rank) {
+    Placement mine, *all = NULL;
+    probe_placement(&mine, ProcRank);
+    if (ProcRank == 0) all = (Placement*)malloc(ProcNum * sizeof(Placement));
+    MPI_Gather(&mine, sizeof(Placement), MPI_BYTE, all, sizeof(Placement), MPI_BYTE, 0, MPI_COMM_WORLD);
+    if (ProcRank != 0) return;
+
+    int nnodes = 0;
+    for (int i = 0; i < ProcNum; i++)
+        if (all[i].node + 1 > nnodes) nnodes = all[i].node + 1;
+
+    int *ranks = (int*)malloc(ProcNum * sizeof(int));
+    char list[64];
+    int min_local = ProcNum, max_local = 0, warnings = 0;
+
+    printf("Размещение: %d узл., %d процессов\n", nnodes, ProcNum);
+    // Заголовки выровнены вручную: printf считает ширину в байтах, а кириллица - два байта на букву
+    printf("Узел  Имя                   Проц.   Ядер  NUMA  Ранги\n");
+    for (int n = 0; n < nnodes; n++) {
+        int cnt = 0;
+        const Placement *first = NULL;
+        for (int i = 0; i < ProcNum; i++) {
+            if (all[i].node != n) continue;
+            if (first == NULL) first = &all[i];
+            ranks[cnt++] = i;
+        }
+        format_ranges(ranks, cnt, list, sizeof(list));
+        printf("%-5d %-20s %6d %6d %5d  %s\n", n, first->host, cnt, first->ncpus, first->nnuma, list);
+        if (cnt < min_local) min_local = cnt;
+        if (cnt > max_local) max_local = cnt;
+
+        // Переподписка: процессов больше, чем ядер - они делят ядра по времени
+        if (cnt > first->ncpus) {
+            printf("Предупреждение: узел %s: %d процессов на %d ядрах (переподписка), "
+                   "времена будут завышены и нестабильны\n", first->host, cnt, first->ncpus);
+            warnings++;
+        }
+
+        // Привязанные процессы с пересекающимися масками делят ядро, даже если ядер хватает
+        int shared = 0, unbound = 0;
+        for (int a = 0; a < cnt; a++) {
+            const Placement *pa = &all[ranks[a]];
+            if (pa->nallowed >= pa->ncpus) {
+                unbound++;
+                continue;
+            }
+            for (int b = a + 1; b < cnt; b++) {
+                const Placement *pb = &all[ranks[b]];
+                cpu_set_t both;
+                if (pb->nallowed >= pb->ncpus) continue;
+                CPU_AND(&both, &pa->mask, &pb->mask);
+                if (CPU_COUNT(&both) > 0) shared++;
+            }
+        }
+        if (shared > 0 && cnt <= first->ncpus) {
+            printf("Предупреждение: узел %s: %d пар процессов привязаны к общим ядрам\n",
+                   first->host, shared);
+            warnings++;
+        }
+        if (unbound > 0 && cnt > 1 && cnt < first->ncpus) {
+            printf("Замечание: узел %s: %d процессов не привязаны к ядрам, ОС может их переносить "
+                   "(mpirun --bind-to core)\n", first->host, unbound);
+        }
+
+        // NUMA: процессы должны делиться между NUMA-узлами поровну (разница не больше одного)
+        if (first->nnuma > 1) {
+            int *per_numa = (int*)calloc(first->nnuma, sizeof(int));
+            int lo = ProcNum, hi = 0;
+            for (int a = 0; a < cnt; a++) {
+                int z = all[ranks[a]].numa;
+                if (z >= 0 && z < first->nnuma) per_numa[z]++;
+            }
+            for (int z = 0; z < first->nnuma; z++) {
+                if (per_numa[z] < lo) lo = per_numa[z];
+                if (per_numa[z] > hi) hi = per_numa[z];
+            }
+            if (hi - lo > 1) {
+                printf("Предупреждение: узел %s: процессы распределены по NUMA-узлам неравномерно "
+                       "(от %d до %d)\n", first->host, lo, hi);
+                warnings++;
+            }
+            free(per_numa);
+        }
+    }
+    if (max_local - min_local > 1) {
+        printf("Предупреждение: неравномерное размещение по узлам: от %d до %d процессов на узел\n",
+               min_local, max_local);
+        warnings++;
+    }
+    if (warnings == 0) printf("Размещение в порядке\n");
+
+    if (per_rank) {
+        printf("\n Ранг  Узел  Лок.  Ядро  NUMA  Привязка\n");
+        for (int i = 0; i < ProcNum; i++) {
+            format_mask(&all[i].mask, list, sizeof(list));
+            printf("%5d %5d %5d %5d %5d  %s\n", i, all[i].node, all[i].local_rank, all[i].core,
+                   all[i].numa, all[i].nallowed >= all[i].ncpus ? "все" : list);
+        }
+    }
+    printf("\n");
+    free(ranks);
+    free(all);
+}
+
+int main(int argc, char *argv[]) {
+    int ProcRank; // Ранг текущего процесса
+    int ProcNum;  // Общее количество процессов
+
+    MPI_Init(&argc, &argv);
+    MPI_Comm_size(MPI_COMM_WORLD, &ProcNum);
+    MPI_Comm_rank(MPI_COMM_WORLD, &ProcRank);
+
+    // Параметры: какие способы сравнивать, сколько повторов, печатать ли список
+    int modes[NUM_MODES] = {1, 1, 1, 1};
+    int reps = 20;
+    int quiet = 0;
+    int per_rank = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--mode=", 7) == 0) {
+            const char *m = argv[i] + 7;
+            if (strcmp(m, "all") != 0) {
+                int found = 0;
+                for (int k = 0; k < NUM_MODES; k++) {
+                    modes[k] = strcmp(m, mode_names[k]) == 0;
+                    found |= modes[k];
+                }
+                if (!found) {
+                    if (ProcRank == 0) fprintf(stderr, "Ошибка: неизвестный способ сбора %s\n", m);
+                    MPI_Finalize();
+                    return 1;
+                }
+            }
+        } else if (strncmp(argv[i], "--reps=", 7) == 0) {
+            reps = atoi(argv[i] + 7);
+            if (reps < 1) reps = 1;
+            if (reps > MAX_REPS) reps = MAX_REPS;
+        } else if (strcmp(argv[i], "--quiet") == 0) {
+            quiet = 1;
+        } else if (strcmp(argv[i], "--placement") == 0) {
+            per_rank = 1;
+        } else if (ProcRank == 0) {
+            fprintf(stderr, "Предупреждение: неизвестный аргумент %s\n", argv[i]);
+        }
+    }
+
+    placement_report(ProcRank, ProcNum, per_rank);
+
+    HelloInfo mine;
+    fill_info(&mine, ProcRank);
+    MPI_Datatype type = info_type();
+
+    HelloInfo *all = NULL, *reference = NULL;
+    if (ProcRank == 0) {
+        all = (HelloInfo*)calloc(ProcNum, sizeof(HelloInfo));
+        reference = (HelloInfo*)calloc(ProcNum, sizeof(HelloInfo));
+    }
+
+    // Эталон для проверки - обычный MPI_Gather (он же дает список, упорядоченный по рангам)
+    collect(MODE_GATHER, &mine, reference, type, ProcRank, ProcNum);
+    if (ProcRank == 0 && !quiet) {
+        for (int i = 0; i < ProcNum; i++)
+            printf("Hello from process %3d (узел %s, pid %d, ядро %d)\n",
+                   reference[i].rank, reference[i].host, reference[i].pid, reference[i].core);
+        printf("\n");
+    }
+
+    if (ProcRank == 0)
+        printf("Способ       мин, мкс медиана, мкс    макс, мкс   Проверка\n"); // выровнено вручную, как и таблица размещения
+
+    double times[MAX_REPS];
+    for (int k = 0; k < NUM_MODES; k++) {
+        if (!modes[k]) continue;
+        // Прогрев (соединения, буферы). Барьер перед ним: иначе быстрый процесс пошлет запись
+        // следующего способа, пока процесс 0 еще принимает от MPI_ANY_SOURCE записи предыдущего
+        MPI_Barrier(MPI_COMM_WORLD);
+        collect(k, &mine, all, type, ProcRank, ProcNum);
+        for (int r = 0; r < reps; r++) {
+            // Все начинают одновременно; время - пока процесс 0 не получил все записи
+            MPI_Barrier(MPI_COMM_WORLD);
+            double start_time = MPI_Wtime();
+            collect(k, &mine, all, type, ProcRank, ProcNum);
+            times[r] = MPI_Wtime() - start_time;
+        }
+        if (ProcRank == 0) {
+            int bad = 0;
+            for (int i = 0; i < ProcNum; i++) {
+                if (all[i].rank != i || all[i].pid != reference[i].pid ||
+                    strcmp(all[i].host, reference[i].host) != 0)
+                    bad++;
+            }
+            qsort(times, reps, sizeof(double), cmp_double);
+            // При четном числе повторов медиана - среднее двух средних элементов
+            double median = (reps % 2) ? times[reps / 2] : 0.5 * (times[reps / 2 - 1] + times[reps / 2]);
+            char check[32];
+            if (bad) snprintf(check, sizeof(check), "%d ошибок", bad);
+            else snprintf(check, sizeof(check), "OK");
+            printf("%-8s %12.1f %12.1f %12.1f %10s\n", mode_names[k],
+                   times[0] * 1e6, median * 1e6, times[reps - 1] * 1e6, check);
+        }
+    }
+
+    if (ProcRank == 0)
+        printf("\nПроцессов: %d, повторов: %d, запись: %d байт\n", ProcNum, reps, (int)sizeof(HelloInfo));
+
+    free(all);
+    free(reference);
+    MPI_Type_free(&type);
+    MPI_Finalize();
+    return 0;
+}
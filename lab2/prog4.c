@@ -1,188 +1,1274 @@
 #include <mpi.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
-#include <unistd.h> 
+#include <unistd.h>
 
 #define MSG_TAG 0         // Тег для обычных данных
 #define TERMINATE_TAG 1 // Тег для сигнала "завершить работу"
+#define TOKEN_TAG 2     // Тег маркера обнаружения завершения
+#define BODY_TAG 3      // Теги полезной нагрузки: BODY_TAG + номер тела у пары соседей по модулю
+#define BODY_TAG_SPAN 30000 // BODY_TAG_SPAN (MPI гарантирует теги до 32767)
 
-// Определяем структуру нашего сообщения
+#define RECV_SLOTS 32       // Сколько приемов держит открытыми событийный маршрутизатор
+#define MAX_BATCHES 16      // Максимум размеров пачки в одном запуске (--batch=1,8,64)
+#define MAX_RATES 16        // Максимум значений нагрузки в одном запуске (--rate=1000,5000)
+#define KNEE_P99_FACTOR 10.0 // Колено: p99 вырос во столько раз относительно самой малой нагрузки
+#define KNEE_ACCEPT 0.9      // ... или сеть принимает меньше этой доли предложенной нагрузки
+
+// Гистограмма задержек в стиле HDR: значения в наносекундах, до 2*HIST_SUB - точно, дальше
+// на каждую степень двойки по HIST_SUB корзин, т.е. относительная ошибка не больше 1/HIST_SUB
+#define HIST_SUB_BITS 5
+#define HIST_SUB (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS (2 * HIST_SUB + 42 * HIST_SUB) // до 2^48 нс (~78 часов)
+
+// Определяем структуру нашего сообщения (заголовок; полезная нагрузка идет отдельным сообщением)
 typedef struct {
     int src;    // Ранг (ID) создателя
     int dest;   // Ранг (ID) получателя
     int ttl;    // Time-To-Live (время жизни)
     int data;   // Полезные данные
+    int len;    // Байт полезной нагрузки (0 - ее нет)
+    int body_tag; // Тег, с которым нагрузка идет на этом переходе
+    double t_send; // Момент создания по часам rank 0 (для задержки доставки)
 } Message;
 
-// Главная функция программы
-int main(int argc, char** argv) {
-    // Основные переменные MPI
+// Маркер Дейкстры-Сафры: обходит кольцо от контроллера 0 и собирает балансы процессов
+typedef struct {
+    long count;  // сумма (отправлено - принято) по пройденным процессам
+    long black;  // 1 - кто-то на пути принимал сообщения с прошлого обхода
+} Token;
+
+// Топология сети: на ней строится таблица маршрутов
+typedef enum { TOPO_RING, TOPO_BIRING, TOPO_TORUS, TOPO_GRAPH } TopoKind;
+
+typedef struct {
+    TopoKind kind;
+    MPI_Comm comm;     // коммуникатор с топологией (MPI_Cart_create / MPI_Dist_graph_create_adjacent)
+    int dims[2];       // решетка тора
+    int nnbr;          // соседей, которым этот процесс отправляет
+    int *nbr;          // их ранги
+    int *route;        // route[dest] - индекс в nbr следующего перехода к dest, -1 - это я сам
+    int eccentricity;  // самый длинный кратчайший путь от этого процесса
+    double mean_dist;  // средняя длина кратчайшего пути от этого процесса к остальным
+} Topology;
+
+// Пачка, копящаяся для одного соседа
+typedef struct {
+    int buf;       // буфер пула, в который она копится
+    int n;         // сообщений в ней
+    double since;  // когда легло первое сообщение
+} OutBatch;
+
+/*
+ * Пул буферов полезной нагрузки: классы размеров - степени двойки от 2^POOL_MIN_SHIFT байт,
+ * у каждого класса стек свободных буферов. Буфер, принятый из сети, уходит дальше тем же
+ * MPI_Isend и возвращается в пул только по завершении отправки, так что на переход не приходится
+ * ни malloc, ни free, ни копирования: malloc бывает лишь, пока пул не прогрелся.
+ */
+#define POOL_MIN_SHIFT 6
+#define POOL_CLASSES 25     // до 2^30 байт
+
+typedef struct {
+    char **free_list[POOL_CLASSES];
+    int nfree[POOL_CLASSES], cap[POOL_CLASSES];
+    long gets;              // запросов буфера
+    long mallocs;           // из них не нашлось свободного - пришлось выделить
+    long long allocated;    // байт выделено всего (размер пула)
+    long long in_use, peak_in_use; // байт в занятых буферах сейчас / в пике
+} Pool;
+
+static int pool_class(int len) {
+    int c = 0;
+    while (c < POOL_CLASSES - 1 && (1 << (c + POOL_MIN_SHIFT)) < len) c++;
+    return c;
+}
+
+static char *pool_get(Pool *p, int len) {
+    int c = pool_class(len);
+    long long bytes = 1LL << (c + POOL_MIN_SHIFT);
+    char *buf;
+    p->gets++;
+    if (p->nfree[c] > 0) {
+        buf = p->free_list[c][--p->nfree[c]];
+    } else {
+        buf = (char*)malloc(bytes);
+        memset(buf, 0x5a, bytes);
+        p->mallocs++;
+        p->allocated += bytes;
+    }
+    p->in_use += bytes;
+    if (p->in_use > p->peak_in_use) p->peak_in_use = p->in_use;
+    return buf;
+}
+
+static void pool_put(Pool *p, char *buf, int len) {
+    int c = pool_class(len);
+    if (p->nfree[c] == p->cap[c]) {
+        p->cap[c] = p->cap[c] ? 2 * p->cap[c] : 16;
+        p->free_list[c] = (char**)realloc(p->free_list[c], p->cap[c] * sizeof(char*));
+    }
+    p->free_list[c][p->nfree[c]++] = buf;
+    p->in_use -= 1LL << (c + POOL_MIN_SHIFT);
+}
+
+static void pool_destroy(Pool *p) {
+    for (int c = 0; c < POOL_CLASSES; c++) {
+        for (int i = 0; i < p->nfree[c]; i++) free(p->free_list[c][i]);
+        free(p->free_list[c]);
+    }
+}
+
+// Распределение адресатов новых сообщений
+typedef enum { DEST_UNIFORM, DEST_HOTSPOT, DEST_NEIGHBOR } DestMode;
+
+// Состояние маршрутизатора одного процесса
+typedef struct {
     int rank, size;
-    MPI_Status status; // Структура для получения статуса (от кого, какой тег)
+    int next, prev;   // Соседи по кольцу: по ним ходят маркер и сигнал завершения
+    int verbose;
+    long delivered;   // Сообщений доставлено этому процессу
+    long dropped;     // Сообщений удалено по TTL на этом процессе
+    long forwarded;   // Сообщений переслано дальше
+    long received;    // Сообщений принято из сети (каждый прием - один переход)
+    long local;       // Сообщений самому себе, доставленных без сети
+    long created;     // Сообщений создано этим процессом
 
-    // Инициализация MPI
-    MPI_Init(&argc, &argv);
-    // Получаем ранг (ID) текущего процесса
-    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
-    // Получаем общее количество процессов
-    MPI_Comm_size(MPI_COMM_WORLD, &size);
+    // Полезная нагрузка: длина нового сообщения - от payload_min до payload_max байт
+    int payload_min, payload_max;
+    Pool pool;
+    long long payload_bytes;   // байт полезной нагрузки принято из сети
+    int *body_seq;             // номер следующего тела для каждого соседа
+    int body_n, body_cap;      // отправки полезной нагрузки в пути
+    MPI_Request *body_req;
+    char **body_buf;
+    int *body_len;
 
-    // Значения по умолчанию
-    int num_messages = 5;
-    int max_ttl = 10;
-    int verbose = 0; // 0 = тихий режим, 1 = подробный
+    // Источник сообщений: залп в начале или генератор открытой нагрузки (--rate), который
+    // вбрасывает сообщения по расписанию, не дожидаясь сети
+    DestMode dest_mode;
+    double hot_frac;      // доля сообщений в горячую точку (процесс 0)
+    int generating;       // генератор еще работает
+    double rate;          // сообщений в секунду
+    double next_inject;   // когда по расписанию следующее сообщение
+    double gen_end;       // когда генератор останавливается
 
-    // Парсинг аргументов командной строки (если они есть)
-    if (argc > 1) num_messages = atoi(argv[1]); // 1-й аргумент - кол-во сообщений
-    if (argc > 2) max_ttl = atoi(argv[2]);      // 2-й аргумент - TTL
-    if (argc > 3) verbose = atoi(argv[3]);      // 3-й аргумент - подробный режим
+    // Измерения на доставке: задержка (гистограмма), число переходов = max_ttl - ttl
+    int max_ttl;
+    double clock_offset;           // часы rank 0 = MPI_Wtime() + clock_offset
+    long lat_hist[HIST_BUCKETS];
+    double lat_max;
+    long hop_sum;
+    int hop_max;
 
-    // Инициализация генератора случайных чисел
-    // гарантирует, что каждый параллельный процесс будет генерировать свою собственную, уникальную последовательность случайных чисел. time(null)
-    // + rank - уникальный посев
-    srand(time(NULL) + rank);
+    // Данные идут по кратчайшему пути: соседу nbr[route[dest]]
+    MPI_Comm comm;
+    int nnbr;
+    const int *nbr;
+    const int *route;
 
-    // Ранг следующего процесса (с "замыканием" size-1 -> 0)
-    int next = (rank + 1) % size;
-    // Ранг предыдущего процесса (с "замыканием" 0 -> size-1)
-    int prev = (rank - 1 + size) % size;
+    // Агрегация (только событийный режим): сообщения для каждого соседа копятся в свою пачку
+    // до batch штук и уходят одной отправкой. batch = 0 - старый путь, MPI_Send на каждое сообщение.
+    int batch;
+    double flush_interval; // пачка уходит не позже, чем через столько секунд после первого сообщения
+    OutBatch *out;         // по пачке на соседа
+    int npending;          // сообщений во всех неотправленных пачках
+    long sends;            // отправок данных (пачек)
 
-    Message msg;      // Буфер для одного сообщения
-    int done = 0;     // Флаг выхода из главного цикла (1 = выходим)
-    
-    double start_time = 0.0, end_time = 0.0; // Для замера времени
-    double last_msg_time = 0.0; // Таймер для "детектора тишины" помогает процессу 0 понять что все сообщения обработаны
+    // Пул буферов отправки: пачка уходит через MPI_Isend, и пока отправка не завершилась,
+    // буфер занят. Отправки не блокируют, поэтому сеть не может встать во взаимной блокировке.
+    int out_cap;
+    Message **out_buf;
+    MPI_Request *out_req;
+    int *out_owner;        // сосед, чья пачка копится в буфере, или -1
 
-    if (rank == 0) {
-        printf("=== Имитация кольцевой топологии ===\n");
-        printf("Процессов: %d\n", size);
-        printf("Сообщений на процесс: %d\n", num_messages);
-        printf("TTL сообщений: %d\n", max_ttl);
-        printf("====================================\n");
-        // Только процесс 0 засекает общее время
-        start_time = MPI_Wtime();
+    double last_activity; // время последнего принятого сообщения (для оценки времени маршрутизации)
+
+    // Обнаружение завершения (Дейкстра-Сафра). Сообщение в пути учтено у отправителя и еще
+    // не учтено у получателя, поэтому сумма балансов равна нулю, только когда сеть пуста.
+    long balance;   // отправлено - принято сообщений на этом процессе
+    int black;      // принимал сообщения с тех пор, как последний раз передал маркер
+    int has_token;  // маркер сейчас у этого процесса
+    Token token;
+    long rounds;    // обходов маркера (считает контроллер 0)
+} Router;
+
+// Отправка пачки соседу k
+static void router_flush_one(Router *r, int k);
+
+// Возвращаем в пул буферы полезной нагрузки, чьи отправки завершились
+static void router_reap_bodies(Router *r) {
+    if (r->body_n == 0) return;
+    int outcount;
+    int *idx = (int*)malloc(r->body_n * sizeof(int));
+    MPI_Testsome(r->body_n, r->body_req, &outcount, idx, MPI_STATUSES_IGNORE);
+    free(idx);
+    if (outcount <= 0) return;
+    int n = 0;
+    for (int i = 0; i < r->body_n; i++) {
+        if (r->body_req[i] == MPI_REQUEST_NULL) {
+            pool_put(&r->pool, r->body_buf[i], r->body_len[i]);
+        } else {
+            r->body_req[n] = r->body_req[i];
+            r->body_buf[n] = r->body_buf[i];
+            r->body_len[n] = r->body_len[i];
+            n++;
+        }
+    }
+    r->body_n = n;
+}
+
+// Полезная нагрузка уходит сразу (в обход пачки) со своим тегом из заголовка: слоты приема
+// отдают пачки не обязательно в порядке прихода, поэтому тело ищется по тегу, а не по очереди
+static void router_send_body(Router *r, int dest, int tag, char *body, int len) {
+    if (r->body_n == r->body_cap) {
+        router_reap_bodies(r);
+        if (r->body_n == r->body_cap) {
+            r->body_cap = r->body_cap ? 2 * r->body_cap : 64;
+            r->body_req = (MPI_Request*)realloc(r->body_req, r->body_cap * sizeof(MPI_Request));
+            r->body_buf = (char**)realloc(r->body_buf, r->body_cap * sizeof(char*));
+            r->body_len = (int*)realloc(r->body_len, r->body_cap * sizeof(int));
+        }
     }
-    
-    // Инициализируем таймер таймаута для ВСЕХ процессов
-    // Это предотвращает ложное срабатывание таймаута до начала симуляции
-    last_msg_time = MPI_Wtime();
+    MPI_Isend(body, len, MPI_BYTE, dest, tag, r->comm, &r->body_req[r->body_n]);
+    r->body_buf[r->body_n] = body;
+    r->body_len[r->body_n] = len;
+    r->body_n++;
+}
 
-    // Каждый процесс "вбрасывает" в кольцо свои сообщения
-    for (int i = 0; i < num_messages; i++) {
-        msg.src = rank;                     // Отправитель - я
-        msg.dest = rand() % size;           // Получатель - случайный
-        msg.ttl = max_ttl;                  // Ставим TTL
-        msg.data = rand() % 1000;           // Случайные данные
+// Передача сообщения следующему на пути к адресату (напрямую или через пачку);
+// body - буфер пула с полезной нагрузкой, после отправки он вернется в пул сам
+static void router_send(Router *r, const Message *msg, char *body) {
+    int k = r->route[msg->dest];
+    Message hdr = *msg;
+    if (hdr.len > 0) {
+        hdr.body_tag = BODY_TAG + r->body_seq[k];
+        r->body_seq[k] = (r->body_seq[k] + 1) % BODY_TAG_SPAN;
+    }
+    r->balance++;
+    if (r->batch == 0) {
+        r->sends++;
+        MPI_Send(&hdr, sizeof(Message), MPI_BYTE, r->nbr[k], MSG_TAG, r->comm);
+    } else {
+        OutBatch *ob = &r->out[k];
+        if (ob->n == 0) ob->since = MPI_Wtime();
+        r->out_buf[ob->buf][ob->n++] = hdr;
+        r->npending++;
+    }
+    if (hdr.len > 0) router_send_body(r, r->nbr[k], hdr.body_tag, body, hdr.len);
+    if (r->batch > 0 && r->out[k].n == r->batch) router_flush_one(r, k); // Сброс по размеру
+}
 
-        // Печатаем, если включен подробный режим
-        if (verbose)
-            printf("Процесс %d создал сообщение для %d (data=%d)\n", rank, msg.dest, msg.data);
+// Прием полезной нагрузки сообщения msg от src в буфер пула (размер - из MPI_Probe / MPI_Get_count)
+static char *router_recv_body(Router *r, const Message *msg, int src) {
+    if (msg->len == 0) return NULL;
+    MPI_Status status;
+    int len;
+    MPI_Probe(src, msg->body_tag, r->comm, &status);
+    MPI_Get_count(&status, MPI_BYTE, &len);
+    char *body = pool_get(&r->pool, len);
+    MPI_Recv(body, len, MPI_BYTE, src, msg->body_tag, r->comm, MPI_STATUS_IGNORE);
+    r->payload_bytes += len;
+    return body;
+}
 
-        // Отправляем сообщение СЛЕДУЮЩЕМУ в кольце не адресату
-        MPI_Send(&msg, sizeof(Message), MPI_BYTE, next, MSG_TAG, MPI_COMM_WORLD);
+// Свободный буфер пула: сначала забираем завершенные отправки, если свободных нет - пул растет
+static int router_free_buffer(Router *r) {
+    for (int pass = 0; pass < 2; pass++) {
+        for (int i = 0; i < r->out_cap; i++) {
+            if (r->out_owner[i] < 0 && r->out_req[i] == MPI_REQUEST_NULL) return i;
+        }
+        if (pass == 0) {
+            int outcount;
+            int *idx = (int*)malloc(r->out_cap * sizeof(int));
+            MPI_Testsome(r->out_cap, r->out_req, &outcount, idx, MPI_STATUSES_IGNORE);
+            free(idx);
+        }
+    }
+    int old = r->out_cap;
+    r->out_cap *= 2;
+    r->out_buf = (Message**)realloc(r->out_buf, r->out_cap * sizeof(Message*));
+    r->out_req = (MPI_Request*)realloc(r->out_req, r->out_cap * sizeof(MPI_Request));
+    r->out_owner = (int*)realloc(r->out_owner, r->out_cap * sizeof(int));
+    for (int i = old; i < r->out_cap; i++) {
+        r->out_buf[i] = (Message*)malloc(r->batch * sizeof(Message));
+        r->out_req[i] = MPI_REQUEST_NULL;
+        r->out_owner[i] = -1;
     }
+    return old;
+}
+
+static void router_flush_one(Router *r, int k) {
+    OutBatch *ob = &r->out[k];
+    if (r->batch == 0 || ob->n == 0) return;
+    MPI_Isend(r->out_buf[ob->buf], ob->n * (int)sizeof(Message), MPI_BYTE, r->nbr[k], MSG_TAG,
+              r->comm, &r->out_req[ob->buf]);
+    r->sends++;
+    r->npending -= ob->n;
+    ob->n = 0;
+    r->out_owner[ob->buf] = -1;
+    ob->buf = router_free_buffer(r);
+    r->out_owner[ob->buf] = k;
+}
+
+// Отправка всех неполных пачек; expired_only = 1 - только тех, что ждут дольше flush_interval
+static void router_flush(Router *r, int expired_only) {
+    if (r->npending == 0) return;
+    double now = MPI_Wtime();
+    for (int k = 0; k < r->nnbr; k++) {
+        if (r->out[k].n > 0 && (!expired_only || now - r->out[k].since >= r->flush_interval))
+            router_flush_one(r, k);
+    }
+}
+
+// Пул на batch сообщений в буфере, по текущему буферу на соседа; batch = 0 - без агрегации
+static void router_open_batching(Router *r, int batch, double flush_interval) {
+    r->batch = batch;
+    r->flush_interval = flush_interval;
+    if (batch == 0) return;
+    r->out_cap = 2 * r->nnbr + 2;
+    r->out_buf = (Message**)malloc(r->out_cap * sizeof(Message*));
+    r->out_req = (MPI_Request*)malloc(r->out_cap * sizeof(MPI_Request));
+    r->out_owner = (int*)malloc(r->out_cap * sizeof(int));
+    for (int i = 0; i < r->out_cap; i++) {
+        r->out_buf[i] = (Message*)malloc(batch * sizeof(Message));
+        r->out_req[i] = MPI_REQUEST_NULL;
+        r->out_owner[i] = -1;
+    }
+    r->out = (OutBatch*)calloc(r->nnbr > 0 ? (size_t)r->nnbr : 1, sizeof(OutBatch));
+    for (int k = 0; k < r->nnbr; k++) {
+        r->out[k].buf = k;
+        r->out_owner[k] = k;
+    }
+}
+
+// Дожидаемся всех отправок и освобождаем пул
+static void router_close_batching(Router *r) {
+    if (r->batch == 0) return;
+    router_flush(r, 0);
+    MPI_Waitall(r->out_cap, r->out_req, MPI_STATUSES_IGNORE);
+    for (int i = 0; i < r->out_cap; i++) free(r->out_buf[i]);
+    free(r->out_buf);
+    free(r->out_req);
+    free(r->out_owner);
+    free(r->out);
+}
+
+// Номер корзины для задержки ns
+static int hist_index(unsigned long long ns) {
+    if (ns < 2 * HIST_SUB) return (int)ns;
+    int e = 63 - __builtin_clzll(ns);     // старший бит, >= HIST_SUB_BITS + 1
+    int shift = e - HIST_SUB_BITS;
+    int idx = 2 * HIST_SUB + (shift - 1) * HIST_SUB + (int)((ns >> shift) - HIST_SUB);
+    return idx < HIST_BUCKETS ? idx : HIST_BUCKETS - 1;
+}
+
+// Верхняя граница корзины idx, нс
+static double hist_value(int idx) {
+    if (idx < 2 * HIST_SUB) return idx;
+    int shift = (idx - 2 * HIST_SUB) / HIST_SUB + 1;
+    unsigned long long mant = HIST_SUB + (idx - 2 * HIST_SUB) % HIST_SUB;
+    return (double)(((mant + 1) << shift) - 1);
+}
+
+// Значение, ниже которого лежит доля q всех отсчетов, нс
+static double hist_percentile(const long *hist, long total, double q) {
+    long rank_q = (long)(q * total + 0.5), seen = 0;
+    if (rank_q < 1) rank_q = 1;
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        seen += hist[i];
+        if (seen >= rank_q) return hist_value(i);
+    }
+    return 0.0;
+}
+
+// Обработка одного принятого сообщения: TTL, доставка или пересылка следующему.
+// Полезная нагрузка body на доставке и удалении возвращается в пул, при пересылке уходит дальше.
+static void route_message(Router *r, Message *msg, char *body) {
+    r->received++;
+    r->balance--;
+    r->black = 1;
+    msg->ttl--; // Уменьшаем TTL
+
+    // Проверяем TTL
+    if (msg->ttl <= 0) {
+        // TTL истек. Сообщение "удаляется" (просто не пересылается)
+        r->dropped++;
+        if (r->rank == 0 && r->verbose) // Контроллер может об этом сообщить
+            printf("Контроллер (0): удалил сообщение от %d к %d (TTL истёк)\n", msg->src, msg->dest);
+        if (body) pool_put(&r->pool, body, msg->len);
+        return;
+    }
+
+    // Проверяем адресата
+    if (msg->dest == r->rank) {
+        // Сообщение пришло МНЕ
+        r->delivered++;
+        double lat = MPI_Wtime() + r->clock_offset - msg->t_send;
+        r->lat_hist[hist_index(lat > 0 ? (unsigned long long)(lat * 1e9) : 0)]++;
+        if (lat > r->lat_max) r->lat_max = lat;
+        int hops = r->max_ttl - msg->ttl;
+        r->hop_sum += hops;
+        if (hops > r->hop_max) r->hop_max = hops;
+        if (r->verbose)
+            printf("Процесс %d получил сообщение от %d (data=%d, ttl=%d)\n",
+                   r->rank, msg->src, msg->data, msg->ttl);
+        if (body) pool_put(&r->pool, body, msg->len);
+    } else {
+        // Сообщение ЧУЖОЕ - пересылаем дальше вместе с тем же буфером нагрузки
+        r->forwarded++;
+        router_send(r, msg, body);
+    }
+}
+
+// Адресат нового сообщения по выбранному распределению
+static int pick_dest(const Router *r) {
+    if (r->dest_mode == DEST_NEIGHBOR)
+        return r->nnbr > 0 ? r->nbr[rand() % r->nnbr] : r->rank;
+    if (r->dest_mode == DEST_HOTSPOT && rand() < r->hot_frac * ((double)RAND_MAX + 1))
+        return 0;
+    return rand() % r->size;
+}
+
+// Длина полезной нагрузки: степень двойки выбирается равномерно, внутри нее - равномерно,
+// т.е. в диапазоне "байты..мегабайты" каждый порядок размера встречается одинаково часто
+static int pick_len(const Router *r) {
+    int lo = r->payload_min, hi = r->payload_max;
+    if (lo >= hi) return lo;
+    // Границы корзин - в long long: при hi = 1 ГБ (1 << 30) сдвиг 2 << 30 в int переполняется
+    int kmin = 0, kmax = 0;
+    while ((2LL << kmin) <= (lo > 0 ? lo : 1)) kmin++;
+    while ((2LL << kmax) <= hi) kmax++;
+    int k = kmin + rand() % (kmax - kmin + 1);
+    long long a = k == kmin ? lo : 1LL << k;
+    long long b = k == kmax ? hi : (2LL << k) - 1;
+    return (int)(a + (long long)((double)rand() / ((double)RAND_MAX + 1) * (b - a + 1)));
+}
+
+// Новое сообщение, созданное в момент t_send (по часам rank 0)
+static void router_inject(Router *r, double t_send) {
+    Message msg;
+    msg.src = r->rank;                  // Отправитель - я
+    msg.dest = pick_dest(r);            // Получатель - по распределению
+    msg.ttl = r->max_ttl;               // Ставим TTL
+    msg.data = rand() % 1000;           // Случайные данные
+    msg.len = pick_len(r);
+    msg.t_send = t_send;
+    r->created++;
+
+    // Печатаем, если включен подробный режим
+    if (r->verbose)
+        printf("Процесс %d создал сообщение для %d (data=%d, %d байт)\n", r->rank, msg.dest, msg.data, msg.len);
+
+    // Сообщение самому себе вне одностороннего кольца по сети не идет
+    if (r->route[msg.dest] < 0) {
+        r->delivered++;
+        r->local++;
+        return;
+    }
+    // Отправляем сообщение первому соседу на кратчайшем пути к адресату
+    router_send(r, &msg, msg.len > 0 ? pool_get(&r->pool, msg.len) : NULL);
+}
+
+// Генератор: вбрасывает все сообщения, чье время по расписанию уже наступило. Отстав, он догоняет
+// расписание, а задержка считается от запланированного момента, так что отставание ее не прячет.
+static void router_generate(Router *r) {
+    if (!r->generating) return;
+    double now = MPI_Wtime();
+    while (r->generating && r->next_inject <= now) {
+        router_inject(r, r->next_inject + r->clock_offset);
+        r->next_inject += 1.0 / r->rate;
+        if (r->next_inject >= r->gen_end) r->generating = 0;
+    }
+}
+
+/*
+ * Передача маркера следующему процессу, как только этот процесс свободен (нет неотправленной
+ * пачки). Процесс добавляет к маркеру свой баланс и "чернит" его, если принимал сообщения.
+ * Контроллер 0, получив маркер обратно, объявляет завершение, если маркер и он сам белые,
+ * а сумма балансов нулевая; иначе запускает новый обход. Возвращает 1 при завершении.
+ */
+static int router_pass_token(Router *r) {
+    if (!r->has_token || r->npending > 0 || r->generating) return 0;
+    if (r->rank == 0) {
+        if (r->rounds > 0 && !r->token.black && !r->black && r->token.count + r->balance == 0)
+            return 1;
+        r->token.count = 0;
+        r->token.black = 0;
+        r->rounds++;
+    } else {
+        r->token.count += r->balance;
+        if (r->black) r->token.black = 1;
+    }
+    r->black = 0;
+    r->has_token = 0;
+    MPI_Send(&r->token, 2, MPI_LONG, r->next, TOKEN_TAG, r->comm);
+    return 0;
+}
+
+// Контроллер 0 рассылает сигнал завершения по кольцу; он же и получит его обратно последним
+static void start_termination(Router *r) {
+    if (r->verbose)
+        printf("Контроллер (0): все сообщения доставлены или удалены (обходов маркера: %ld), "
+               "рассылаем сигнал завершения\n", r->rounds);
+
+    // Отправляем сигнал СЛЕДУЮЩЕМУ
+    MPI_Send(NULL, 0, MPI_BYTE, r->next, TERMINATE_TAG, r->comm);
+}
+
+/*
+ * Старый режим (--mode=poll): MPI_Iprobe + usleep(100) на каждой итерации.
+ * За итерацию принимается не больше одного сообщения, поэтому каждый переход
+ * стоит минимум 100 мкс, а простаивающий процесс все равно крутит цикл.
+ */
+static void run_poll(Router *r) {
+    Message msg;      // Буфер для одного сообщения
+    MPI_Status status; // Структура для получения статуса (от кого, какой тег)
+    int done = 0;     // Флаг выхода из главного цикла (1 = выходим)
+    int terminating = 0; // Контроллер 0 уже разослал сигнал завершения
 
     while (!done) {
         int flag = 0; // Флаг: есть ли сообщение? (0=нет, 1=да)
 
-        
-        // MPI_Iprobe "смотрит" в очередь, не зависая, есть ли что-то от 'prev'
-        MPI_Iprobe(prev, MPI_ANY_TAG, MPI_COMM_WORLD, &flag, &status);
+
+        // MPI_Iprobe "смотрит" в очередь, не зависая, есть ли что-то от любого соседа
+        MPI_Iprobe(MPI_ANY_SOURCE, MPI_ANY_TAG, r->comm, &flag, &status);
 
         // Если сообщение ЕСТЬ (flag = 1)
         if (flag) {
-            // Раз мы что-то получили, значит, сеть активна.
-            // Сбрасываем таймер "детектора тишины"
-            last_msg_time = MPI_Wtime();
-
             // Проверяем ТЕГ сообщения (до того, как его приняли)
 	    //Этот код проверяет тег сообщения до того, как его принять. Это позволяет процессу отличить обычное сообщение с данными (MSG_TAG) от 			специальной команды (сигнала TERMINATE_TAG), чтобы понять, нужно ли обрабатывать данные или пора завершать работу.
             if (status.MPI_TAG == TERMINATE_TAG) {
-                
+
                 // Мы должны принять сигнал (даже если он пустой),
                 // чтобы он исчез из очереди.
-                MPI_Recv(NULL, 0, MPI_BYTE, prev, TERMINATE_TAG, MPI_COMM_WORLD, &status);
-                
+                MPI_Recv(NULL, 0, MPI_BYTE, r->prev, TERMINATE_TAG, r->comm, &status);
+
                 done = 1; // Ставим флаг "завершаемся"
-                
+
                 // Пересылаем сигнал дальше по кольцу
-                // (rank != next - защита для случая с 1 процессом)
-                if (rank != next) 
-                    MPI_Send(NULL, 0, MPI_BYTE, next, TERMINATE_TAG, MPI_COMM_WORLD);
-                
+                // (у контроллера 0 сигнал уже обошел все кольцо)
+                if (r->rank != 0)
+                    MPI_Send(NULL, 0, MPI_BYTE, r->next, TERMINATE_TAG, r->comm);
+
                 continue; // Переходим к следующей итерации (в !done будет 0)
             }
 
-            // Если это не сигнал, значит, это обычное сообщение
-            // Теперь мы его принимаем (блокирующе, но мы знаем, что оно есть)
-            MPI_Recv(&msg, sizeof(Message), MPI_BYTE, prev, MSG_TAG, MPI_COMM_WORLD, &status);
+            if (status.MPI_TAG == TOKEN_TAG) {
+                // Пришел маркер: запоминаем, передадим ниже
+                MPI_Recv(&r->token, 2, MPI_LONG, r->prev, TOKEN_TAG, r->comm, &status);
+                r->has_token = 1;
+            } else {
 
-            // Обрабатываем сообщение
-            msg.ttl--; // Уменьшаем TTL
+                // Если это не сигнал, значит, это обычное сообщение
+                // Теперь мы его принимаем (блокирующе, но мы знаем, что оно есть)
+                MPI_Recv(&msg, sizeof(Message), MPI_BYTE, status.MPI_SOURCE, MSG_TAG, r->comm, &status);
 
-            // Проверяем TTL
-            if (msg.ttl <= 0) {
-                // TTL истек. Сообщение "удаляется" (просто не пересылается)
-                if (rank == 0 && verbose) // Контроллер может об этом сообщить
-                    printf("Контроллер (0): удалил сообщение от %d к %d (TTL истёк)\n", msg.src, msg.dest);
-                continue; // Переходим к след. итерации
+                // Обрабатываем сообщение (полезная нагрузка идет следом от того же соседа)
+                route_message(r, &msg, router_recv_body(r, &msg, status.MPI_SOURCE));
+                r->last_activity = MPI_Wtime();
             }
+        }
 
-            // Проверяем адресата
-            if (msg.dest == rank) {
-                // Сообщение пришло МНЕ
-                if (verbose)
-                    printf("Процесс %d получил сообщение от %d (data=%d, ttl=%d)\n",
-                           rank, msg.src, msg.data, msg.ttl);
-            } else {
-                // Сообщение ЧУЖОЕ - пересылаем дальше
-                MPI_Send(&msg, sizeof(Message), MPI_BYTE, next, MSG_TAG, MPI_COMM_WORLD);
-            }
-        } 
-
-        
-        // Логика "детектора тишины" (только у Контроллера 0)
-        if (rank == 0) {
-            // Проверяем, как давно была последняя активность (получение)
-            if (MPI_Wtime() - last_msg_time > 2.0) { // Таймаут = 2 секунды
-                
-                if (!done) { // Отправляем сигнал только один раз
-                    if (verbose)
-                        printf("Контроллер (0): таймаут (тишина в сети), рассылаем сигнал завершения\n");
-                    
-                    // Отправляем сигнал СЛЕДУЮЩЕМУ
-                    MPI_Send(NULL, 0, MPI_BYTE, next, TERMINATE_TAG, MPI_COMM_WORLD);
-                    
-                    // Контроллер 0 сам себя тоже должен остановить
-                    done = 1;
-                }
-            }
-        } 
+        router_generate(r);
+        router_reap_bodies(r);
+
+        // Маркер идет дальше; если контроллер 0 обнаружил завершение, он рассылает сигнал
+        // (сам он остановится, когда сигнал вернется к нему по кольцу)
+        if (!terminating && router_pass_token(r)) {
+            start_termination(r);
+            terminating = 1;
+        }
 
         // Небольшая пауза (100 микросекунд), чтобы цикл 'while'
         // не загружал CPU на 100%, пока ждет сообщений (в 'else')
         usleep(100);
     } // --- Конец while(!done) ---
+}
+
+/*
+ * Событийный режим (--mode=event, по умолчанию).
+ * Заранее открыто RECV_SLOTS постоянных приемов данных от любого соседа (MPI_Recv_init
+ * с MPI_ANY_SOURCE), прием сигнала завершения и прием маркера от prev. MPI_Waitsome за один вызов отдает ВСЕ пришедшие
+ * к этому моменту сообщения; каждый слот сразу же перезапускается (MPI_Start).
+ * Без трафика процесс спит внутри MPI_Waitsome; конец работы определяет маркер.
+ * С агрегацией слот принимает целую пачку (до batch сообщений, длина - из MPI_Get_count),
+ * а пока в исходящей пачке что-то лежит, процесс опрашивает, чтобы вовремя ее сбросить.
+ */
+typedef struct {
+    int nreq;             // RECV_SLOTS приемов данных + сигнал завершения + маркер
+    int slot_msgs;        // сообщений в буфере одного слота
+    Message *slots;       // буферы постоянных приемов
+    Token token;          // буфер приема маркера
+    MPI_Request reqs[RECV_SLOTS + 2];
+} EventQueue;
+
+#define TERMINATE_SLOT RECV_SLOTS
+#define TOKEN_SLOT (RECV_SLOTS + 1)
+
+// Приемы открываются до вбрасывания сообщений: пачки могут идти по протоколу rendezvous
+static void event_open(Router *r, EventQueue *q) {
+    q->nreq = RECV_SLOTS + 2;
+    q->slot_msgs = r->batch > 0 ? r->batch : 1;
+    q->slots = (Message*)malloc((size_t)RECV_SLOTS * q->slot_msgs * sizeof(Message));
+    for (int i = 0; i < RECV_SLOTS; i++)
+        MPI_Recv_init(&q->slots[(size_t)i * q->slot_msgs], q->slot_msgs * (int)sizeof(Message), MPI_BYTE,
+                      MPI_ANY_SOURCE, MSG_TAG, r->comm, &q->reqs[i]);
+    MPI_Recv_init(NULL, 0, MPI_BYTE, r->prev, TERMINATE_TAG, r->comm, &q->reqs[TERMINATE_SLOT]);
+    MPI_Recv_init(&q->token, 2, MPI_LONG, r->prev, TOKEN_TAG, r->comm, &q->reqs[TOKEN_SLOT]);
+    MPI_Startall(q->nreq, q->reqs);
+}
+
+static void run_event(Router *r, EventQueue *q) {
+    int indices[RECV_SLOTS + 2];
+    MPI_Status statuses[RECV_SLOTS + 2];
+    int done = 0;
+    int terminating = 0;
+
+    while (!done) {
+        // Маркер передается до ожидания: иначе процесс без трафика заснет, держа маркер
+        if (!terminating && router_pass_token(r)) {
+            start_termination(r);
+            terminating = 1;
+        }
+
+        int outcount;
+        if (r->npending > 0 || r->generating) MPI_Testsome(q->nreq, q->reqs, &outcount, indices, statuses);
+        else MPI_Waitsome(q->nreq, q->reqs, &outcount, indices, statuses);
+
+        for (int k = 0; k < outcount; k++) {
+            int i = indices[k];
+            if (i == TERMINATE_SLOT) {
+                // Сигнал завершения: передаем дальше по кольцу (к контроллеру 0 он вернулся)
+                done = 1;
+                if (r->rank != 0)
+                    MPI_Send(NULL, 0, MPI_BYTE, r->next, TERMINATE_TAG, r->comm);
+                continue;
+            }
+            if (i == TOKEN_SLOT) {
+                r->token = q->token;
+                r->has_token = 1;
+                MPI_Start(&q->reqs[i]);
+                continue;
+            }
+            // Маршрутизируем всю пачку прямо из буфера слота и снова открываем слот
+            int bytes;
+            MPI_Get_count(&statuses[k], MPI_BYTE, &bytes);
+            Message *batch = &q->slots[(size_t)i * q->slot_msgs];
+            int src = statuses[k].MPI_SOURCE;
+            for (int j = 0; j < bytes / (int)sizeof(Message); j++)
+                route_message(r, &batch[j], router_recv_body(r, &batch[j], src));
+            MPI_Start(&q->reqs[i]);
+        }
+        if (outcount > 0 && !done) r->last_activity = MPI_Wtime();
+
+        // Сброс по времени: пачка ждет не дольше flush_interval
+        router_flush(r, 1);
+        router_reap_bodies(r);
+
+        // Генератор: без трафика спим до следующего сообщения по расписанию, но не дольше 50 мкс
+        router_generate(r);
+        if (r->generating && outcount == 0 && r->npending == 0) {
+            double gap = r->next_inject - MPI_Wtime();
+            if (gap > 0) usleep(gap < 50e-6 ? (useconds_t)(gap * 1e6) : 50);
+        }
+    }
+}
+
+// Закрываем оставшиеся открытыми приемы
+static void event_close(EventQueue *q) {
+    for (int i = 0; i < q->nreq; i++) {
+        int flag;
+        MPI_Test(&q->reqs[i], &flag, MPI_STATUS_IGNORE);
+        if (!flag) {
+            MPI_Cancel(&q->reqs[i]);
+            MPI_Wait(&q->reqs[i], MPI_STATUS_IGNORE);
+        }
+        MPI_Request_free(&q->reqs[i]);
+    }
+    free(q->slots);
+}
+
+// Ребра графа из файла: по строке "u v" на ребро, '#' - комментарий. Читает rank 0, рассылает всем.
+static int *read_edges(const char *path, int size, int *nedges) {
+    int rank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    int n = 0, cap = 64;
+    int *e = (int*)malloc(2 * cap * sizeof(int));
+    if (rank == 0) {
+        FILE *f = fopen(path, "r");
+        if (!f) {
+            fprintf(stderr, "Ошибка: не удалось открыть файл графа %s\n", path);
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        char line[256];
+        while (fgets(line, sizeof(line), f)) {
+            int u, v;
+            if (line[0] == '#' || sscanf(line, "%d %d", &u, &v) != 2) continue;
+            if (u < 0 || v < 0 || u >= size || v >= size) {
+                fprintf(stderr, "Ошибка: ребро %d-%d вне диапазона рангов 0..%d\n", u, v, size - 1);
+                MPI_Abort(MPI_COMM_WORLD, 1);
+            }
+            if (n == cap) {
+                cap *= 2;
+                e = (int*)realloc(e, 2 * cap * sizeof(int));
+            }
+            e[2 * n] = u;
+            e[2 * n + 1] = v;
+            n++;
+        }
+        fclose(f);
+    }
+    MPI_Bcast(&n, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    e = (int*)realloc(e, 2 * (n > 0 ? n : 1) * sizeof(int));
+    MPI_Bcast(e, 2 * n, MPI_INT, 0, MPI_COMM_WORLD);
+    *nedges = n;
+    return e;
+}
+
+/*
+ * Строит коммуникатор с топологией и таблицу маршрутов. Вся сеть известна каждому процессу
+ * (матрица связей link[i*size + j] = 1, если i отправляет j), поэтому поиск в ширину от себя
+ * дает для каждого адресата первый переход кратчайшего пути. Ранги не переставляются (reorder = 0),
+ * так что ранг в t->comm совпадает с рангом в MPI_COMM_WORLD.
+ */
+static void topology_build(Topology *t, TopoKind kind, const char *graph_path) {
+    int rank, size;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+    t->kind = kind;
+    t->dims[0] = size;
+    t->dims[1] = 1;
+
+    unsigned char *link = (unsigned char*)calloc((size_t)size * size, 1);
+    if (kind == TOPO_RING || kind == TOPO_BIRING) {
+        int periodic = 1;
+        MPI_Cart_create(MPI_COMM_WORLD, 1, &size, &periodic, 0, &t->comm);
+        for (int i = 0; i < size; i++) {
+            link[(size_t)i * size + (i + 1) % size] = 1;
+            if (kind == TOPO_BIRING) link[(size_t)i * size + (i - 1 + size) % size] = 1;
+        }
+    } else if (kind == TOPO_TORUS) {
+        int periods[2] = {1, 1};
+        t->dims[0] = t->dims[1] = 0;
+        MPI_Dims_create(size, 2, t->dims);
+        MPI_Cart_create(MPI_COMM_WORLD, 2, t->dims, periods, 0, &t->comm);
+        for (int i = 0; i < size; i++) {
+            int c[2];
+            MPI_Cart_coords(t->comm, i, 2, c);
+            for (int d = 0; d < 2; d++) {
+                for (int s = -1; s <= 1; s += 2) {
+                    int nc[2] = {c[0], c[1]}, j;
+                    nc[d] += s; // выход за край решетки MPI_Cart_rank заворачивает сам
+                    MPI_Cart_rank(t->comm, nc, &j);
+                    if (j != i) link[(size_t)i * size + j] = 1;
+                }
+            }
+        }
+    } else {
+        int nedges;
+        int *e = read_edges(graph_path, size, &nedges);
+        for (int k = 0; k < nedges; k++) { // ребра неориентированные
+            int u = e[2 * k], v = e[2 * k + 1];
+            if (u == v) continue;
+            link[(size_t)u * size + v] = 1;
+            link[(size_t)v * size + u] = 1;
+        }
+        free(e);
+    }
+
+    t->nbr = (int*)malloc(size * sizeof(int));
+    t->nnbr = 0;
+    for (int j = 0; j < size; j++)
+        if (link[(size_t)rank * size + j]) t->nbr[t->nnbr++] = j;
+    if (kind == TOPO_GRAPH) {
+        // Ребра неориентированные: соседи и по входу, и по выходу одни и те же
+        int *weights = (int*)malloc(size * sizeof(int));
+        for (int k = 0; k < t->nnbr; k++) weights[k] = 1;
+        MPI_Dist_graph_create_adjacent(MPI_COMM_WORLD, t->nnbr, t->nbr, weights,
+                                       t->nnbr, t->nbr, weights, MPI_INFO_NULL, 0, &t->comm);
+        free(weights);
+    }
+
+    // Поиск в ширину от себя: first[v] - через какого соседа идет кратчайший путь к v
+    int *dist = (int*)malloc(size * sizeof(int));
+    int *queue = (int*)malloc(size * sizeof(int));
+    t->route = (int*)malloc(size * sizeof(int));
+    for (int v = 0; v < size; v++) dist[v] = -1;
+    dist[rank] = 0;
+    t->route[rank] = -1;
+    int head = 0, tail = 0;
+    for (int k = 0; k < t->nnbr; k++) {
+        int v = t->nbr[k];
+        if (dist[v] < 0) {
+            dist[v] = 1;
+            t->route[v] = k;
+            queue[tail++] = v;
+        }
+    }
+    while (head < tail) {
+        int u = queue[head++];
+        for (int v = 0; v < size; v++) {
+            if (link[(size_t)u * size + v] && dist[v] < 0) {
+                dist[v] = dist[u] + 1;
+                t->route[v] = t->route[u];
+                queue[tail++] = v;
+            }
+        }
+    }
+    // В одностороннем кольце сообщение самому себе, как и раньше, обходит все кольцо
+    if (kind == TOPO_RING) t->route[rank] = 0;
+
+    t->eccentricity = 0;
+    long sum = 0;
+    for (int v = 0; v < size; v++) {
+        if (dist[v] < 0) {
+            fprintf(stderr, "Ошибка: процесс %d не может достичь процесса %d (граф несвязный)\n", rank, v);
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        if (dist[v] > t->eccentricity) t->eccentricity = dist[v];
+        sum += dist[v];
+    }
+    t->mean_dist = size > 1 ? (double)sum / (size - 1) : 0.0;
+    free(dist);
+    free(queue);
+    free(link);
+}
+
+static void topology_free(Topology *t) {
+    MPI_Comm_free(&t->comm);
+    free(t->nbr);
+    free(t->route);
+}
+
+/*
+ * Смещение часов процесса относительно rank 0 (алгоритм Кристиана): процесс спрашивает время
+ * у rank 0 и считает, что ответ снят посередине обмена; из CLOCK_SYNC_ROUNDS замеров берется
+ * самый быстрый. Если MPI_Wtime уже общий для всех (MPI_WTIME_IS_GLOBAL), смещение нулевое.
+ */
+#define CLOCK_SYNC_ROUNDS 10
+static double clock_offset(void) {
+    int rank, size, flag, *is_global;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+    MPI_Comm_get_attr(MPI_COMM_WORLD, MPI_WTIME_IS_GLOBAL, &is_global, &flag);
+    if (flag && *is_global) return 0.0;
+
+    double offset = 0.0, best_rtt = 1e30;
+    for (int p = 1; p < size; p++) { // по одному процессу, чтобы rank 0 отвечал без очереди
+        for (int k = 0; k < CLOCK_SYNC_ROUNDS; k++) {
+            if (rank == 0) {
+                MPI_Recv(NULL, 0, MPI_BYTE, p, TOKEN_TAG, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+                double now = MPI_Wtime();
+                MPI_Send(&now, 1, MPI_DOUBLE, p, TOKEN_TAG, MPI_COMM_WORLD);
+            } else if (rank == p) {
+                double t0 = MPI_Wtime(), t_root;
+                MPI_Send(NULL, 0, MPI_BYTE, 0, TOKEN_TAG, MPI_COMM_WORLD);
+                MPI_Recv(&t_root, 1, MPI_DOUBLE, 0, TOKEN_TAG, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+                double t1 = MPI_Wtime();
+                if (t1 - t0 < best_rtt) {
+                    best_rtt = t1 - t0;
+                    offset = t_root - (t0 + t1) / 2;
+                }
+            }
+        }
+    }
+    return offset;
+}
+
+// Параметры одного прогона
+typedef struct {
+    int num_messages, max_ttl, verbose;
+    int poll_mode;
+    int batch;             // 0 - без агрегации
+    double flush_interval;
+    double clock_offset;   // смещение часов этого процесса относительно rank 0
+    double rate;           // > 0 - генератор: сообщений в секунду на процесс, 0 - залп из num_messages
+    double duration;       // сколько секунд работает генератор
+    DestMode dest_mode;
+    double hot_frac;
+    int payload_min, payload_max; // байт полезной нагрузки в сообщении
+} SimConfig;
+
+// Итог прогона (суммы по всем процессам, на rank 0)
+typedef struct {
+    long created;
+    long delivered, dropped, forwarded, sends;
+    long hops;             // приемов из сети по всем процессам
+    long rounds;           // обходов маркера завершения
+    double elapsed;        // полное время, включая обнаружение завершения
+    double route_time;     // от старта до последнего принятого сообщения (максимум по процессам)
+    long local;            // доставлено самому себе без сети
+    double lat_p50, lat_p99, lat_max; // задержка доставки по сети, с
+    double hop_mean;
+    int hop_max;
+    long drop_max;         // больше всего удалений по TTL на одном процессе
+    int drop_max_rank;     // ... и на каком
+    long payload_bytes;    // байт полезной нагрузки принято из сети (по всем переходам)
+    long pool_gets, pool_mallocs; // запросов буфера к пулам / из них с malloc
+    long pool_allocated;   // байт во всех пулах
+    long long pool_peak;   // пик занятых байт пула на одном процессе
+    long pool_leaked;      // байт, не вернувшихся в пул (должно быть 0)
+} SimResult;
+
+// Один полный прогон: вбрасывание, маршрутизация, завершение
+static void simulate(const SimConfig *cfg, const Topology *t, SimResult *res) {
+    int rank, size;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+    Router r;
+    memset(&r, 0, sizeof(r));
+    r.rank = rank;
+    r.size = size;
+    r.verbose = cfg->verbose;
+    r.max_ttl = cfg->max_ttl;
+    r.clock_offset = cfg->clock_offset;
+    r.payload_min = cfg->payload_min;
+    r.payload_max = cfg->payload_max;
+    r.dest_mode = cfg->dest_mode;
+    r.hot_frac = cfg->hot_frac;
+    // Ранг следующего процесса (с "замыканием" size-1 -> 0)
+    r.next = (rank + 1) % size;
+    // Ранг предыдущего процесса (с "замыканием" 0 -> size-1)
+    r.prev = (rank - 1 + size) % size;
+    r.comm = t->comm;
+    r.nnbr = t->nnbr;
+    r.nbr = t->nbr;
+    r.route = t->route;
+    r.body_seq = (int*)calloc(t->nnbr > 0 ? (size_t)t->nnbr : 1, sizeof(int));
+
+    EventQueue q;
+    if (!cfg->poll_mode) {
+        router_open_batching(&r, cfg->batch, cfg->flush_interval);
+        event_open(&r, &q);
+    }
+
+    // Все стартуют одновременно: время считается от общего барьера
+    MPI_Barrier(MPI_COMM_WORLD);
+    double start_time = MPI_Wtime(); // Для замера времени
+    r.last_activity = start_time;
+    r.has_token = (rank == 0); // Первый обход маркера начинает контроллер 0
+
+    if (cfg->rate > 0) {
+        // Генератор: равномерное расписание со случайной фазой, чтобы процессы не шли в такт
+        r.rate = cfg->rate;
+        r.generating = 1;
+        r.gen_end = start_time + cfg->duration;
+        r.next_inject = start_time + (double)rand() / ((double)RAND_MAX + 1) / cfg->rate;
+    } else {
+        // Каждый процесс "вбрасывает" в сеть свои сообщения
+        for (int i = 0; i < cfg->num_messages; i++) router_inject(&r, MPI_Wtime() + r.clock_offset);
+        router_flush(&r, 0);
+    }
+
+    if (cfg->poll_mode) {
+        run_poll(&r);
+    } else {
+        run_event(&r, &q);
+        event_close(&q);
+        router_close_batching(&r);
+    }
+    // Дожидаемся отправок нагрузки: все тела уже приняты, раз маркер насчитал ноль
+    MPI_Waitall(r.body_n, r.body_req, MPI_STATUSES_IGNORE);
+    for (int i = 0; i < r.body_n; i++) pool_put(&r.pool, r.body_buf[i], r.body_len[i]);
+    free(r.body_req);
+    free(r.body_buf);
+    free(r.body_len);
+    free(r.body_seq);
 
-    
-    
     // Ждем, пока ВСЕ процессы выйдут из цикла 'while'
     MPI_Barrier(MPI_COMM_WORLD);
+    double elapsed = MPI_Wtime() - start_time;
+    double route_time = r.last_activity - start_time;
+
+    // Итог по всем процессам: доставлено + удалено по TTL должно совпасть с созданным
+    long local[13] = {r.delivered, r.dropped, r.forwarded, r.sends, r.received, r.local, r.hop_sum, r.created,
+                      (long)r.payload_bytes, r.pool.gets, r.pool.mallocs, (long)r.pool.allocated, (long)r.pool.in_use};
+    long total[13];
+    MPI_Reduce(local, total, 13, MPI_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+    MPI_Reduce(&route_time, &res->route_time, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
 
-    // Только процесс 0 печатает итог
+    // Гистограммы складываются, максимумы - по максимуму, удаления - с рангом худшего процесса
+    long *hist = rank == 0 ? (long*)malloc(HIST_BUCKETS * sizeof(long)) : NULL;
+    MPI_Reduce(r.lat_hist, hist, HIST_BUCKETS, MPI_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+    MPI_Reduce(&r.lat_max, &res->lat_max, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+    MPI_Reduce(&r.hop_max, &res->hop_max, 1, MPI_INT, MPI_MAX, 0, MPI_COMM_WORLD);
+    MPI_Reduce(&r.pool.peak_in_use, &res->pool_peak, 1, MPI_LONG_LONG, MPI_MAX, 0, MPI_COMM_WORLD);
+    pool_destroy(&r.pool);
+    struct { long count; int rank; } drops = {r.dropped, rank}, worst;
+    MPI_Reduce(&drops, &worst, 1, MPI_LONG_INT, MPI_MAXLOC, 0, MPI_COMM_WORLD);
     if (rank == 0) {
-        end_time = MPI_Wtime();
-        double elapsed = end_time - start_time;
+        long n = total[0] - total[5]; // доставлено по сети
+        res->lat_p50 = n ? hist_percentile(hist, n, 0.50) * 1e-9 : 0.0;
+        res->lat_p99 = n ? hist_percentile(hist, n, 0.99) * 1e-9 : 0.0;
+        // Граница корзины может оказаться выше точного максимума
+        if (res->lat_p50 > res->lat_max) res->lat_p50 = res->lat_max;
+        if (res->lat_p99 > res->lat_max) res->lat_p99 = res->lat_max;
+        res->hop_mean = n ? (double)total[6] / n : 0.0;
+        res->drop_max = worst.count;
+        res->drop_max_rank = worst.rank;
+        free(hist);
+    }
+    res->delivered = total[0];
+    res->dropped = total[1];
+    res->forwarded = total[2];
+    res->sends = total[3];
+    res->hops = total[4];
+    res->local = total[5];
+    res->created = total[7];
+    res->payload_bytes = total[8];
+    res->pool_gets = total[9];
+    res->pool_mallocs = total[10];
+    res->pool_allocated = total[11];
+    res->pool_leaked = total[12];
+    res->rounds = r.rounds;
+    res->elapsed = elapsed;
+}
+
+// Размер в байтах с необязательным суффиксом K или M, от 0 до 1 ГБ.
+// Ограничение проверяется до сдвига: иначе большое значение переполнит long еще при умножении
+static int parse_bytes(char *s, char **end) {
+    long v = strtol(s, end, 10);
+    int shift = 0;
+    if (**end == 'K' || **end == 'k') { shift = 10; (*end)++; }
+    else if (**end == 'M' || **end == 'm') { shift = 20; (*end)++; }
+    if (v < 0) v = 0;
+    if (v > ((1L << 30) >> shift)) v = (1L << 30) >> shift;
+    return (int)(v << shift);
+}
+
+// Главная функция программы
+int main(int argc, char** argv) {
+    // Основные переменные MPI
+    int rank, size;
+
+    // Инициализация MPI
+    MPI_Init(&argc, &argv);
+    // Получаем ранг (ID) текущего процесса
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    // Получаем общее количество процессов
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+    // Значения по умолчанию
+    SimConfig cfg;
+    cfg.num_messages = 5;
+    cfg.max_ttl = 10;
+    cfg.verbose = 0;   // 0 = тихий режим, 1 = подробный
+    cfg.poll_mode = 0; // --mode=poll: старый цикл Iprobe + usleep, --mode=event: событийный
+    cfg.flush_interval = 50e-6; // --flush-us=T: сброс неполной пачки через T мкс
+    int batches[MAX_BATCHES] = {1}; // --batch=B1,B2,...: размеры пачки, по прогону на каждый
+    int nbatches = 1;
+    TopoKind topo = TOPO_RING; // --topo=ring|biring|torus|graph:FILE
+    const char *graph_path = NULL;
+    double rates[MAX_RATES] = {0}; // --rate=R1,R2,...: генератор, сообщений/с на процесс (0 - залп)
+    int nrates = 1;
+    cfg.duration = 1.0;        // --duration=S: секунд работы генератора
+    cfg.dest_mode = DEST_UNIFORM; // --dest=uniform|hotspot[:доля]|neighbor
+    cfg.hot_frac = 0.5;
+    cfg.payload_min = cfg.payload_max = 0; // --payload=B или MIN:MAX (суффиксы K, M): байт нагрузки
+
+    // Парсинг аргументов командной строки (если они есть).
+    // Позиционные аргументы - как раньше, флаги вида --имя=значение - в любом месте.
+    int npos = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--mode=poll") == 0) cfg.poll_mode = 1;
+        else if (strcmp(argv[i], "--mode=event") == 0) cfg.poll_mode = 0;
+        else if (strncmp(argv[i], "--batch=", 8) == 0) {
+            nbatches = 0;
+            for (char *p = argv[i] + 8; *p && nbatches < MAX_BATCHES; ) {
+                int b = (int)strtol(p, &p, 10);
+                batches[nbatches++] = b < 1 ? 1 : b;
+                if (*p == ',') p++;
+                else break;
+            }
+            if (nbatches == 0) batches[nbatches++] = 1;
+        }
+        else if (strcmp(argv[i], "--topo=ring") == 0) topo = TOPO_RING;
+        else if (strcmp(argv[i], "--topo=biring") == 0) topo = TOPO_BIRING;
+        else if (strcmp(argv[i], "--topo=torus") == 0) topo = TOPO_TORUS;
+        else if (strncmp(argv[i], "--topo=graph:", 13) == 0) {
+            topo = TOPO_GRAPH;
+            graph_path = argv[i] + 13;
+        }
+        else if (strncmp(argv[i], "--flush-us=", 11) == 0) cfg.flush_interval = atof(argv[i] + 11) * 1e-6;
+        else if (strncmp(argv[i], "--rate=", 7) == 0) {
+            nrates = 0;
+            for (char *p = argv[i] + 7; *p && nrates < MAX_RATES; ) {
+                double v = strtod(p, &p);
+                if (v > 0) rates[nrates++] = v;
+                if (*p == ',') p++;
+                else break;
+            }
+            if (nrates == 0) rates[nrates++] = 0;
+        }
+        else if (strncmp(argv[i], "--duration=", 11) == 0) cfg.duration = atof(argv[i] + 11);
+        else if (strcmp(argv[i], "--dest=uniform") == 0) cfg.dest_mode = DEST_UNIFORM;
+        else if (strcmp(argv[i], "--dest=neighbor") == 0) cfg.dest_mode = DEST_NEIGHBOR;
+        else if (strncmp(argv[i], "--dest=hotspot", 14) == 0) {
+            cfg.dest_mode = DEST_HOTSPOT;
+            if (argv[i][14] == ':') cfg.hot_frac = atof(argv[i] + 15);
+        }
+        else if (strncmp(argv[i], "--payload=", 10) == 0) {
+            char *p = argv[i] + 10;
+            cfg.payload_min = cfg.payload_max = parse_bytes(p, &p);
+            if (*p == ':') cfg.payload_max = parse_bytes(p + 1, &p);
+            if (cfg.payload_max < cfg.payload_min) cfg.payload_max = cfg.payload_min;
+        }
+        else if (strncmp(argv[i], "--", 2) == 0) {
+            if (rank == 0) fprintf(stderr, "Предупреждение: неизвестный флаг %s\n", argv[i]);
+        }
+        else if (npos == 0) { cfg.num_messages = atoi(argv[i]); npos++; } // 1-й аргумент - кол-во сообщений
+        else if (npos == 1) { cfg.max_ttl = atoi(argv[i]); npos++; }      // 2-й аргумент - TTL
+        else if (npos == 2) { cfg.verbose = atoi(argv[i]); npos++; }      // 3-й аргумент - подробный режим
+    }
+    if (cfg.poll_mode && (nbatches > 1 || batches[0] > 1)) {
+        if (rank == 0) fprintf(stderr, "Предупреждение: --batch работает только в режиме event, игнорируется\n");
+        nbatches = 1;
+        batches[0] = 1;
+    }
+    // Нагрузки - по возрастанию: колено ищется от самой малой
+    for (int i = 1; i < nrates; i++) {
+        for (int j = i; j > 0 && rates[j - 1] > rates[j]; j--) {
+            double tmp = rates[j];
+            rates[j] = rates[j - 1];
+            rates[j - 1] = tmp;
+        }
+    }
+
+    // Инициализация генератора случайных чисел
+    // гарантирует, что каждый параллельный процесс будет генерировать свою собственную, уникальную последовательность случайных чисел. time(null)
+    // + rank - уникальный посев
+    srand(time(NULL) + rank);
 
-        printf("\n=== РЕЗУЛЬТАТ ===\n");
+    Topology t;
+    topology_build(&t, topo, graph_path);
+    // Диаметр сети и средняя длина кратчайшего пути: столько переходов в среднем делает сообщение
+    int diameter;
+    double mean_dist;
+    MPI_Reduce(&t.eccentricity, &diameter, 1, MPI_INT, MPI_MAX, 0, MPI_COMM_WORLD);
+    MPI_Reduce(&t.mean_dist, &mean_dist, 1, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+    cfg.clock_offset = clock_offset();
+
+    if (rank == 0) {
+        printf("=== Имитация сети с маршрутизацией ===\n");
         printf("Процессов: %d\n", size);
-        printf("Сообщений/процесс: %d\n", num_messages);
-        printf("TTL сообщений: %d\n", max_ttl);
-        printf("Время выполнения: %.6f секунд\n", elapsed);
+        if (topo == TOPO_RING) printf("Топология: кольцо (одностороннее)\n");
+        else if (topo == TOPO_BIRING) printf("Топология: кольцо (двустороннее)\n");
+        else if (topo == TOPO_TORUS) printf("Топология: тор %dx%d\n", t.dims[0], t.dims[1]);
+        else printf("Топология: граф из %s\n", graph_path);
+        printf("Диаметр: %d, средний кратчайший путь: %.2f перехода\n", diameter, mean_dist / size);
+        if (rates[0] > 0)
+            printf("Генератор: %.1f с на каждую нагрузку\n", cfg.duration);
+        else
+            printf("Сообщений на процесс: %d\n", cfg.num_messages);
+        if (cfg.dest_mode == DEST_HOTSPOT) printf("Адресаты: горячая точка (%.0f%% в процесс 0)\n", cfg.hot_frac * 100);
+        else if (cfg.dest_mode == DEST_NEIGHBOR) printf("Адресаты: соседи\n");
+        else printf("Адресаты: равномерно\n");
+        if (cfg.payload_max > cfg.payload_min)
+            printf("Полезная нагрузка: %d..%d байт (равномерно по степеням двойки)\n", cfg.payload_min, cfg.payload_max);
+        else if (cfg.payload_max > 0)
+            printf("Полезная нагрузка: %d байт\n", cfg.payload_max);
+        printf("TTL сообщений: %d\n", cfg.max_ttl);
+        printf("Режим: %s\n", cfg.poll_mode ? "poll (Iprobe + usleep)" : "event (постоянные приемы + Waitsome)");
+        if (cfg.verbose)
+            printf("Внимание: подробный вывод (printf на каждом переходе) искажает задержки\n");
+        printf("======================================\n");
+    }
+
+    // Прогоны: каждый размер пачки на каждой нагрузке
+    static SimResult res[MAX_BATCHES][MAX_RATES];
+    for (int b = 0; b < nbatches; b++) {
+        for (int k = 0; k < nrates; k++) {
+            // Пачка из 1 сообщения - это старый путь без агрегации (MPI_Send на каждое сообщение)
+            cfg.batch = batches[b] > 1 ? batches[b] : 0;
+            cfg.rate = rates[k];
+            SimResult *rs = &res[b][k];
+            simulate(&cfg, &t, rs);
+
+            // Только процесс 0 печатает итог
+            if (rank == 0) {
+                printf("\n=== РЕЗУЛЬТАТ%s ===\n", nbatches > 1 || batches[b] > 1 ? " (агрегация)" : "");
+                printf("Процессов: %d\n", size);
+                if (cfg.rate > 0)
+                    printf("Нагрузка: %.0f сообщений/с на процесс (всего %.0f/с), %.1f с\n",
+                           cfg.rate, cfg.rate * size, cfg.duration);
+                else
+                    printf("Сообщений/процесс: %d\n", cfg.num_messages);
+                printf("TTL сообщений: %d\n", cfg.max_ttl);
+                if (!cfg.poll_mode)
+                    printf("Пачка: до %d сообщений, сброс через %.0f мкс\n", batches[b], cfg.flush_interval * 1e6);
+                printf("Доставлено: %ld, удалено по TTL: %ld, пересылок: %ld (создано %ld)\n",
+                       rs->delivered, rs->dropped, rs->forwarded, rs->created);
+                printf("Переходов на сообщение: %.2f\n", rs->created ? (double)rs->hops / rs->created : 0.0);
+                if (rs->local > 0) printf("Доставлено самому себе без сети: %ld\n", rs->local);
+                printf("Задержка доставки: p50 %.1f мкс, p99 %.1f мкс, макс %.1f мкс\n",
+                       rs->lat_p50 * 1e6, rs->lat_p99 * 1e6, rs->lat_max * 1e6);
+                printf("Переходов до доставки: среднее %.2f, макс %d\n", rs->hop_mean, rs->hop_max);
+                if (rs->dropped > 0)
+                    printf("Больше всего удалений по TTL: %ld на процессе %d\n", rs->drop_max, rs->drop_max_rank);
+                if (rs->pool_gets > 0) {
+                    printf("Пересылка нагрузки: %.1f МБ за %.6f с = %.1f МБ/с\n", rs->payload_bytes / 1e6,
+                           rs->route_time, rs->route_time > 0 ? rs->payload_bytes / 1e6 / rs->route_time : 0.0);
+                    printf("Пул буферов: %ld запросов, %ld malloc (%.2f%%), пик занятых %.1f МБ на процесс, "
+                           "выделено всего %.1f МБ\n", rs->pool_gets, rs->pool_mallocs,
+                           100.0 * rs->pool_mallocs / rs->pool_gets, rs->pool_peak / 1e6, rs->pool_allocated / 1e6);
+                    if (rs->pool_leaked != 0)
+                        printf("Ошибка: в пулы не вернулось %ld байт\n", rs->pool_leaked);
+                }
+                printf("Время маршрутизации: %.6f секунд\n", rs->route_time);
+                printf("Время выполнения: %.6f секунд (обходов маркера: %ld)\n", rs->elapsed, rs->rounds);
+            }
+        }
+    }
+
+    // Пропускная способность и задержки в зависимости от размера пачки и нагрузки
+    if (rank == 0) {
+        printf("\n%8s %14s %14s %14s %14s %14s %12s %12s %12s\n", "Пачка", "Нагрузка/проц", "Маршрут., с",
+               "Доставлено/с", "Переходов/с", "Средняя пачка", "p50, мкс", "p99, мкс", "МБ/с");
+        for (int b = 0; b < nbatches; b++) {
+            for (int k = 0; k < nrates; k++) {
+                const SimResult *rs = &res[b][k];
+                double tr = rs->route_time > 0 ? rs->route_time : 1e-9;
+                long sent = rs->created - rs->local + rs->forwarded;
+                char load[32];
+                if (rates[k] > 0) snprintf(load, sizeof(load), "%.0f", rates[k]);
+                else snprintf(load, sizeof(load), "залп");
+                printf("%8d %14s %14.6f %14.0f %14.0f %14.2f %12.1f %12.1f %12.1f\n", batches[b], load, rs->route_time,
+                       rs->delivered / tr, rs->hops / tr, rs->sends ? (double)sent / rs->sends : 0.0,
+                       rs->lat_p50 * 1e6, rs->lat_p99 * 1e6, rs->payload_bytes / 1e6 / tr);
+            }
+        }
+
+        // Колено: первая нагрузка, на которой p99 вырос в KNEE_P99_FACTOR раз относительно самой
+        // малой или сеть перестала успевать (принято меньше KNEE_ACCEPT предложенного).
+        // Устойчивая пропускная способность - лучшая доставка до колена.
+        for (int b = 0; b < nbatches && nrates > 1; b++) {
+            int knee = -1;
+            double sustained = 0.0;
+            for (int k = 0; k < nrates; k++) {
+                const SimResult *rs = &res[b][k];
+                double tr = rs->route_time > 0 ? rs->route_time : 1e-9;
+                double accepted = (rs->delivered + rs->dropped) / tr;
+                if (rs->lat_p99 > KNEE_P99_FACTOR * res[b][0].lat_p99 || accepted < KNEE_ACCEPT * rates[k] * size) {
+                    knee = k;
+                    break;
+                }
+                if (rs->delivered / tr > sustained) sustained = rs->delivered / tr;
+            }
+            printf("\nПачка %d: устойчиво %.0f доставок/с", batches[b], sustained);
+            if (knee > 0)
+                printf(", колено между %.0f и %.0f сообщ/с на процесс (p99 %.1f -> %.1f мкс)\n",
+                       rates[knee - 1], rates[knee], res[b][knee - 1].lat_p99 * 1e6, res[b][knee].lat_p99 * 1e6);
+            else if (knee == 0)
+                printf(", сеть перегружена уже при %.0f сообщ/с на процесс\n", rates[0]);
+            else
+                printf(", колено не достигнуто до %.0f сообщ/с на процесс\n", rates[nrates - 1]);
+        }
     }
 
-    
+    topology_free(&t);
     MPI_Finalize();
-    return 0; 
+    return 0;
 }
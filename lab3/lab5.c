@@ -1,25 +1,811 @@
 
 #include <stdio.h>  
 #include <stdlib.h> 
+#include <string.h>
+#include <stdint.h>
+#include <float.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
 #include <mpi.h>    
 
 
-#define N 8  // 8 строк
-#define M 10 // 10 столбцов
+// Размер матрицы по умолчанию; другой задается при запуске: mpirun -np 4 ./lab5 100000 1000
+#define DEFAULT_N 8  // 8 строк
+#define DEFAULT_M 10 // 10 столбцов
+
+/*
+ * Потоковый режим: матрица лежит в файле (double подряд, по строкам) и целиком
+ * в память не загружается - ее можно сделать больше оперативной памяти узла.
+ *   mpirun -np 4 ./lab5 1000000 1000 --file=m.bin --generate   создать тестовый файл и сложить
+ *   mpirun -np 4 ./lab5 0 1000 --file=m.bin --stream=mpiio     N = 0 - по размеру файла
+ * Способы чтения (--stream):
+ *   mmap  - процесс 0 отображает файл в память и раздает порции через MPI_Iscatterv прямо оттуда
+ *   read  - процесс 0 читает порции pread() в два буфера и раздает через MPI_Iscatterv
+ *   mpiio - каждый процесс сам читает свои строки через MPI_File_iread_at, без раздачи
+ * Везде порция N+1 уже читается/раздается, пока суммируется порция N (два буфера).
+ *
+ * Кроме суммы за тот же проход считаются минимум, максимум, среднее, нормы L1 и L2,
+ * суммы строк и столбцов. Способ суммирования (--sum):
+ *   plain    - один аккумулятор, строго по порядку (как было)
+ *   pairwise - попарно: блоки по BLOCK элементов, внутри блока LANES аккумуляторов
+ *   kahan    - LANES аккумуляторов с точной поправкой (TwoSum), итог в двойной-двойной точности
+ * Между процессами суммы складываются пользовательской операцией MPI тоже с поправкой,
+ * поэтому для kahan результат практически не зависит от числа процессов.
+ *
+ * Проверка (--verify):
+ *   checksum - каждый процесс в том же проходе считает контрольную сумму каждой
+ *              своей строки и сравнивает с суммой строки тестовой матрицы i+j (ее значения
+ *              вычисляются на лету, из памяти не читаются); итог - MPI_Allreduce.
+ *              Работа O(N*M/P) на процесс вместо O(N*M) на процессе 0.
+ *              Годится только для матрицы i+j: по умолчанию - в памяти и с --generate
+ *   serial   - как раньше: процесс 0 складывает всю матрицу еще раз сам (только без --file)
+ *   none     - без проверки; по умолчанию для готового файла (--file без --generate),
+ *              в котором может быть что угодно
+ *
+ * Сборка: mpicc -O3 -march=native lab5.c -o lab5 -lm
+ * (-O3 - чтобы независимые аккумуляторы легли в SIMD-регистры)
+ */
+#define DEFAULT_CHUNK_BYTES (64L * 1024 * 1024) // размер порции по умолчанию (всей, на все процессы)
+#define SUM_BLOCK 65536 // через столько элементов суммирования - MPI_Test следующей порции
+
+// Способы чтения файла в потоковом режиме
+enum { STREAM_MMAP, STREAM_READ, STREAM_MPIIO };
+
+#define LANES 8   // независимых аккумуляторов: без -ffast-math только так сумма векторизуется
+#define BLOCK 256 // элементов строки за раз: блок остается в кэше L1 для всех ядер
+
+// Способы суммирования
+enum { SUM_PLAIN, SUM_PAIRWISE, SUM_KAHAN };
+
+// Способы проверки результата
+enum { VERIFY_CHECKSUM, VERIFY_SERIAL, VERIFY_NONE };
+static const char *sum_names[] = {"plain", "pairwise", "kahan"};
 
 /*
  * Вспомогательная функция для заполнения матрицы тестовыми данными.
- * Принимает указатель на 1D-массив (который представляет 2D-матрицу)
+ * Принимает указатель на 1D-массив (который представляет 2D-матрицу).
+ * first_row - номер первой строки во всей матрице (при записи файла порциями он не 0).
+ * Индексы - size_t: матрица может занимать много гигабайт, и i * cols не влезет в int
  */
-void initialize_matrix(double *matrix, int rows, int cols) {
+void initialize_matrix(double *matrix, int first_row, int rows, int cols) {
     // Проходим по каждой строке
-    for (int i = 0; i < rows; i++) {
+    for (size_t i = 0; i < (size_t)rows; i++) {
         // Проходим по каждому столбцу
-        for (int j = 0; j < cols; j++) {
+        for (size_t j = 0; j < (size_t)cols; j++) {
             // matrix[i][j] в 1D-массиве = matrix[i * cols + j]
-            matrix[i * cols + j] = i + j; // Заполняем данными i+j
+            matrix[i * cols + j] = (double)(first_row + i + j); // Заполняем данными i+j
+        }
+    }
+}
+
+/*
+ * Размер из аргумента командной строки: целое от min до INT_MAX
+ * (столько строк или столбцов MPI может описать одним счетчиком int)
+ */
+static int parse_size(const char *arg, int def, int min) {
+    if (arg == NULL) return def;
+    char *end;
+    long long v = strtoll(arg, &end, 10);
+    if (end == arg || *end != '\0' || v < min || v > 2147483647LL) return -1;
+    return (int)v;
+}
+
+// Размер в байтах с необязательным суффиксом K, M или G: 512K, 64M
+static long parse_bytes(const char *s) {
+    char *end;
+    long v = strtol(s, &end, 10);
+    if (*end == 'K' || *end == 'k') { v <<= 10; end++; }
+    else if (*end == 'M' || *end == 'm') { v <<= 20; end++; }
+    else if (*end == 'G' || *end == 'g') { v <<= 30; end++; }
+    return (end == s || *end != '\0') ? -1 : v;
+}
+
+/*
+ * Раскладка rows строк по size процессам: по rows / size каждому, остаток - первым, по одной.
+ * displs - от начала порции
+ */
+static void split_rows(int rows, int size, int *counts, int *displs) {
+    int offset = 0;
+    for (int p = 0; p < size; p++) {
+        counts[p] = rows / size + (p < rows % size ? 1 : 0);
+        displs[p] = offset;
+        offset += counts[p];
+    }
+}
+
+// Точная сумма двух чисел: s + err == a + b (TwoSum Кнута, без ветвлений - векторизуется)
+static inline void two_sum(double a, double b, double *s, double *err) {
+    double sum = a + b, bb = sum - a;
+    *err = (a - (sum - bb)) + (b - bb);
+    *s = sum;
+}
+
+// hi + lo += bhi + blo в двойной-двойной точности
+static inline void dd_add(double *hi, double *lo, double bhi, double blo) {
+    double s, e;
+    two_sum(*hi, bhi, &s, &e);
+    e += *lo + blo;
+    two_sum(s, e, hi, lo);
+}
+
+/*
+ * Попарное суммирование потоком: частичные суммы хранятся по уровням, как разряды
+ * двоичного счетчика, - складываются всегда суммы одинакового числа слагаемых
+ */
+typedef struct {
+    double level[64];
+    long n; // сколько слагаемых добавлено
+} Pairwise;
+
+static void pw_add(Pairwise *p, double v) {
+    int k = 0;
+    for (; (p->n >> k) & 1; k++) v = p->level[k] + v;
+    p->level[k] = v;
+    p->n++;
+}
+
+static double pw_total(const Pairwise *p) {
+    double t = 0.0;
+    for (int k = 0; k < 64; k++)
+        if ((p->n >> k) & 1) t += p->level[k];
+    return t;
+}
+
+/*
+ * Итог редукции одного процесса (и всех вместе). Только double -
+ * для MPI это просто MPI_Type_contiguous из MPI_DOUBLE
+ */
+typedef struct {
+    double sum_hi, sum_lo;   // сумма: sum_hi + sum_lo
+    double min, max;
+    double l1, l2sq;         // сумма модулей и сумма квадратов
+    double count;            // число элементов
+    double row_min, row_max; // наименьшая и наибольшая суммы строк
+} MatrixStats;
+
+// Контрольная сумма строки: Флетчер по битам double в LANES дорожках (s2 зависит от позиции)
+typedef struct {
+    uint64_t s1[LANES], s2[LANES];
+} RowChecksum;
+
+// Перемешивание битов (финализатор splitmix64)
+static inline uint64_t mix64(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+static void checksum_block(RowChecksum *ck, const double *a, int n) {
+    uint64_t s1[LANES], s2[LANES];
+    memcpy(s1, ck->s1, sizeof(s1));
+    memcpy(s2, ck->s2, sizeof(s2));
+    int i = 0;
+    for (; i + LANES <= n; i += LANES) {
+        for (int l = 0; l < LANES; l++) {
+            uint64_t w;
+            memcpy(&w, &a[i + l], sizeof(w));
+            s1[l] += w;
+            s2[l] += s1[l];
+        }
+    }
+    for (; i < n; i++) {
+        uint64_t w;
+        memcpy(&w, &a[i], sizeof(w));
+        s1[0] += w;
+        s2[0] += s1[0];
+    }
+    memcpy(ck->s1, s1, sizeof(s1));
+    memcpy(ck->s2, s2, sizeof(s2));
+}
+
+// Итог строки вместе с ее номером: та же строка не на своем месте дает другую сумму
+static uint64_t checksum_final(const RowChecksum *ck, long long row) {
+    uint64_t h = mix64((uint64_t)row);
+    for (int l = 0; l < LANES; l++) h = mix64(h ^ ck->s1[l]) ^ ck->s2[l];
+    return mix64(h);
+}
+
+// Локальная редукция: все, что процесс накапливает по своим строкам
+typedef struct {
+    int kind, M;
+    int verify;              // считать ли контрольные суммы строк (VERIFY_CHECKSUM)
+    long long bad_rows;      // строк, не совпавших с тестовой матрицей i+j
+    uint64_t fingerprint;    // XOR контрольных сумм всех строк - отпечаток данных
+    double mn[LANES], mx[LANES], l1[LANES], l2[LANES]; // по дорожкам
+    Pairwise rows;           // попарная сумма сумм строк (SUM_PAIRWISE)
+    MatrixStats st;
+    double *col_hi, *col_lo; // суммы столбцов (col_lo - поправки для SUM_KAHAN)
+    size_t since_test;       // элементов с последнего MPI_Test
+} Reducer;
+
+static void reducer_init(Reducer *rd, int kind, int verify, int M) {
+    memset(rd, 0, sizeof(*rd));
+    rd->kind = kind;
+    rd->verify = verify;
+    rd->M = M;
+    for (int l = 0; l < LANES; l++) {
+        rd->mn[l] = INFINITY;
+        rd->mx[l] = -INFINITY;
+    }
+    rd->st.row_min = INFINITY;
+    rd->st.row_max = -INFINITY;
+    rd->col_hi = (double*)calloc(M, sizeof(double));
+    rd->col_lo = (double*)calloc(M, sizeof(double));
+}
+
+static void reducer_free(Reducer *rd) {
+    free(rd->col_hi);
+    free(rd->col_lo);
+}
+
+/*
+ * Минимум, максимум, модули и квадраты блока по дорожкам; хвост короче LANES - в дорожку 0.
+ * Дорожки - в локальных массивах: через rd-> компилятор боится, что они пересекаются с a,
+ * и не векторизует
+ */
+static void block_lanes(Reducer *rd, const double *a, int n) {
+    double mn[LANES], mx[LANES], l1[LANES], l2[LANES];
+    memcpy(mn, rd->mn, sizeof(mn));
+    memcpy(mx, rd->mx, sizeof(mx));
+    memcpy(l1, rd->l1, sizeof(l1));
+    memcpy(l2, rd->l2, sizeof(l2));
+    int i = 0;
+    for (; i + LANES <= n; i += LANES) {
+        for (int l = 0; l < LANES; l++) {
+            double x = a[i + l];
+            mn[l] = x < mn[l] ? x : mn[l];
+            mx[l] = x > mx[l] ? x : mx[l];
+            l1[l] += fabs(x);
+            l2[l] += x * x;
+        }
+    }
+    for (; i < n; i++) {
+        double x = a[i];
+        mn[0] = x < mn[0] ? x : mn[0];
+        mx[0] = x > mx[0] ? x : mx[0];
+        l1[0] += fabs(x);
+        l2[0] += x * x;
+    }
+    memcpy(rd->mn, mn, sizeof(mn));
+    memcpy(rd->mx, mx, sizeof(mx));
+    memcpy(rd->l1, l1, sizeof(l1));
+    memcpy(rd->l2, l2, sizeof(l2));
+}
+
+// Сумма блока по LANES аккумуляторам (лист попарного суммирования)
+static double block_sum_lanes(const double *a, int n) {
+    double s[LANES] = {0.0};
+    int i = 0;
+    for (; i + LANES <= n; i += LANES)
+        for (int l = 0; l < LANES; l++) s[l] += a[i + l];
+    double t = 0.0;
+    for (int l = 0; l < LANES; l++) t += s[l];
+    for (; i < n; i++) t += a[i];
+    return t;
+}
+
+// Компенсированная сумма блока: s[l] + c[l] - сумма слагаемых дорожки l с ошибкой порядка c
+static void block_kahan(const double *a, int n, double *ps, double *pc) {
+    double s[LANES], c[LANES];
+    memcpy(s, ps, sizeof(s));
+    memcpy(c, pc, sizeof(c));
+    int i = 0;
+    for (; i + LANES <= n; i += LANES) {
+        for (int l = 0; l < LANES; l++) {
+            double e;
+            two_sum(s[l], a[i + l], &s[l], &e);
+            c[l] += e;
+        }
+    }
+    for (; i < n; i++) {
+        double e;
+        two_sum(s[0], a[i], &s[0], &e);
+        c[0] += e;
+    }
+    memcpy(ps, s, sizeof(s));
+    memcpy(pc, c, sizeof(c));
+}
+
+/*
+ * Одна строка с номером gi во всей матрице: сумма выбранным способом, статистика,
+ * суммы столбцов и, если нужно, контрольная сумма в сравнении с тестовой строкой
+ */
+static void reducer_row(Reducer *rd, const double *row, long long gi) {
+    int M = rd->M;
+    double hi = 0.0, lo = 0.0;
+    double s[LANES] = {0.0}, c[LANES] = {0.0};
+    Pairwise pw;
+    pw.n = 0;
+    RowChecksum got, want;
+    double expected[BLOCK];
+    if (rd->verify == VERIFY_CHECKSUM) {
+        memset(&got, 0, sizeof(got));
+        memset(&want, 0, sizeof(want));
+    }
+
+    for (int j = 0; j < M; j += BLOCK) {
+        int n = (M - j < BLOCK) ? M - j : BLOCK;
+        block_lanes(rd, row + j, n);
+        if (rd->verify == VERIFY_CHECKSUM) {
+            // Блок еще в кэше; ожидаемые значения - как в initialize_matrix, без чтения памяти
+            checksum_block(&got, row + j, n);
+            for (int k = 0; k < n; k++) expected[k] = (double)(gi + j + k);
+            checksum_block(&want, expected, n);
+        }
+        if (rd->kind == SUM_PLAIN) {
+            for (int k = 0; k < n; k++) hi += row[j + k];
+        } else if (rd->kind == SUM_PAIRWISE) {
+            pw_add(&pw, block_sum_lanes(row + j, n));
+        } else {
+            block_kahan(row + j, n, s, c);
         }
     }
+    if (rd->kind == SUM_PAIRWISE) hi = pw_total(&pw);
+    if (rd->kind == SUM_KAHAN)
+        for (int l = 0; l < LANES; l++) dd_add(&hi, &lo, s[l], c[l]);
+
+    if (rd->verify == VERIFY_CHECKSUM) {
+        uint64_t h = checksum_final(&got, gi);
+        if (h != checksum_final(&want, gi)) rd->bad_rows++;
+        rd->fingerprint ^= h;
+    }
+
+    double row_sum = hi + lo;
+    if (row_sum < rd->st.row_min) rd->st.row_min = row_sum;
+    if (row_sum > rd->st.row_max) rd->st.row_max = row_sum;
+
+    if (rd->kind == SUM_PLAIN) rd->st.sum_hi += hi;
+    else if (rd->kind == SUM_PAIRWISE) pw_add(&rd->rows, hi);
+    else dd_add(&rd->st.sum_hi, &rd->st.sum_lo, hi, lo);
+
+    // Столбцы: цикл по j без зависимостей между итерациями, векторизуется сам
+    if (rd->kind == SUM_KAHAN) {
+        for (int j = 0; j < M; j++) {
+            double e;
+            two_sum(rd->col_hi[j], row[j], &rd->col_hi[j], &e);
+            rd->col_lo[j] += e;
+        }
+    } else {
+        for (int j = 0; j < M; j++) rd->col_hi[j] += row[j];
+    }
+    rd->st.count += M;
+}
+
+/*
+ * rows строк подряд, первая - строка first_row всей матрицы. Каждые SUM_BLOCK элементов - MPI_Test неблокирующей операции pending
+ * (может быть NULL): многие реализации MPI продвигают ее только внутри вызовов MPI, и без этого
+ * следующая порция не шла бы, пока мы считаем
+ */
+static void reducer_rows(Reducer *rd, const double *a, long long first_row, int rows, MPI_Request *pending) {
+    for (int i = 0; i < rows; i++) {
+        reducer_row(rd, a + (size_t)i * rd->M, first_row + i);
+        rd->since_test += rd->M;
+        if (rd->since_test >= SUM_BLOCK && pending != NULL && *pending != MPI_REQUEST_NULL) {
+            int done;
+            MPI_Test(pending, &done, MPI_STATUS_IGNORE);
+            rd->since_test = 0;
+        }
+    }
+}
+
+// Свести дорожки и попарный стек в rd->st
+static void reducer_finish(Reducer *rd) {
+    MatrixStats *st = &rd->st;
+    st->min = INFINITY;
+    st->max = -INFINITY;
+    for (int l = 0; l < LANES; l++) {
+        if (rd->mn[l] < st->min) st->min = rd->mn[l];
+        if (rd->mx[l] > st->max) st->max = rd->mx[l];
+        st->l1 += rd->l1[l];
+        st->l2sq += rd->l2[l];
+    }
+    if (rd->kind == SUM_PAIRWISE) st->sum_hi = pw_total(&rd->rows);
+}
+
+// Операция MPI для MatrixStats: суммы - с поправкой, остальное - min/max/сумма
+static void stats_op(void *in, void *inout, int *len, MPI_Datatype *type) {
+    MatrixStats *a = (MatrixStats*)in, *b = (MatrixStats*)inout;
+    (void)type;
+    for (int i = 0; i < *len; i++) {
+        dd_add(&b[i].sum_hi, &b[i].sum_lo, a[i].sum_hi, a[i].sum_lo);
+        if (a[i].min < b[i].min) b[i].min = a[i].min;
+        if (a[i].max > b[i].max) b[i].max = a[i].max;
+        b[i].l1 += a[i].l1;
+        b[i].l2sq += a[i].l2sq;
+        b[i].count += a[i].count;
+        if (a[i].row_min < b[i].row_min) b[i].row_min = a[i].row_min;
+        if (a[i].row_max > b[i].row_max) b[i].row_max = a[i].row_max;
+    }
+}
+
+// Операция MPI для пар (hi, lo): сложение в двойной-двойной точности
+static void dd_sum_op(void *in, void *inout, int *len, MPI_Datatype *type) {
+    double *a = (double*)in, *b = (double*)inout;
+    (void)type;
+    for (int i = 0; i < *len; i++) dd_add(&b[2 * i], &b[2 * i + 1], a[2 * i], a[2 * i + 1]);
+}
+
+/*
+ * Сбор статистики всех процессов на процесс 0 пользовательскими операциями и печать.
+ * Вызывают все процессы; возвращает общую статистику (значима на процессе 0)
+ */
+static MatrixStats reduce_and_report(Reducer *rd, int world_rank) {
+    MPI_Datatype stats_type, pair_type;
+    MPI_Op stats_sum, pair_sum;
+    int M = rd->M;
+
+    reducer_finish(rd);
+    MPI_Type_contiguous(sizeof(MatrixStats) / sizeof(double), MPI_DOUBLE, &stats_type);
+    MPI_Type_commit(&stats_type);
+    MPI_Type_contiguous(2, MPI_DOUBLE, &pair_type);
+    MPI_Type_commit(&pair_type);
+    MPI_Op_create(stats_op, 1, &stats_sum); // 1 - операция коммутативна
+    MPI_Op_create(dd_sum_op, 1, &pair_sum);
+
+    MatrixStats total;
+    memset(&total, 0, sizeof(total));
+    MPI_Reduce(&rd->st, &total, 1, stats_type, stats_sum, 0, MPI_COMM_WORLD);
+
+    // Суммы столбцов - парами (hi, lo) подряд
+    double *cols = (double*)malloc(2 * (size_t)M * sizeof(double));
+    double *all_cols = (world_rank == 0) ? (double*)malloc(2 * (size_t)M * sizeof(double)) : NULL;
+    for (int j = 0; j < M; j++) {
+        cols[2 * j] = rd->col_hi[j];
+        cols[2 * j + 1] = rd->col_lo[j];
+    }
+    MPI_Reduce(cols, all_cols, M, pair_type, pair_sum, 0, MPI_COMM_WORLD);
+
+    if (world_rank == 0) {
+        double sum = total.sum_hi + total.sum_lo;
+        double col_min = INFINITY, col_max = -INFINITY;
+        for (int j = 0; j < M; j++) {
+            double c = all_cols[2 * j] + all_cols[2 * j + 1];
+            if (c < col_min) col_min = c;
+            if (c > col_max) col_max = c;
+        }
+        printf("Общая параллельная сумма (%s): %.17g\n", sum_names[rd->kind], sum);
+        printf("Минимум: %g, максимум: %g, среднее: %.17g\n", total.min, total.max,
+               total.count > 0 ? sum / total.count : 0.0);
+        printf("Норма L1: %.17g, норма L2: %.17g\n", total.l1, sqrt(total.l2sq));
+        printf("Суммы строк: от %.17g до %.17g; суммы столбцов: от %.17g до %.17g\n",
+               total.row_min, total.row_max, col_min, col_max);
+        free(all_cols);
+    }
+    free(cols);
+    MPI_Op_free(&stats_sum);
+    MPI_Op_free(&pair_sum);
+    MPI_Type_free(&stats_type);
+    MPI_Type_free(&pair_type);
+    return total;
+}
+
+/*
+ * Параллельная проверка: счетчики и отпечатки всех процессов складываются MPI_Allreduce,
+ * так что результат знают все. Процесс 0 еще сверяет сумму с формулой для матрицы i+j
+ * (допуск - оценка ошибки выбранного способа суммирования) и рассылает итог, чтобы все
+ * процессы вернули одно и то же. Возвращает 1, если все сошлось
+ */
+static int verify_results(const Reducer *rd, const MatrixStats *total, int N, int M, int world_rank) {
+    long long mine[2] = {rd->bad_rows, (long long)rd->st.count}, all[2];
+    uint64_t fingerprint;
+    MPI_Allreduce(mine, all, 2, MPI_LONG_LONG, MPI_SUM, MPI_COMM_WORLD);
+    MPI_Allreduce(&rd->fingerprint, &fingerprint, 1, MPI_UINT64_T, MPI_BXOR, MPI_COMM_WORLD);
+
+    long long total_elements = (long long)N * M;
+    int ok = (all[0] == 0 && all[1] == total_elements);
+    if (world_rank == 0) {
+        // Сумма тестовой матрицы i+j: M * (0 + ... + N-1) + N * (0 + ... + M-1)
+        double expected = (double)M * N * (N - 1.0) / 2.0 + (double)N * M * (M - 1.0) / 2.0;
+        double sum = total->sum_hi + total->sum_lo;
+        double tol = (rd->kind == SUM_KAHAN ? 4.0 : (double)total_elements) * DBL_EPSILON * total->l1;
+        int sum_ok = fabs(sum - expected) <= tol;
+        if (ok && sum_ok) {
+            printf("Проверка (контрольные суммы строк на каждом процессе): OK, строк %d, отпечаток %016llx\n",
+                   N, (unsigned long long)fingerprint);
+        } else {
+            printf("Проверка: ОШИБКА - строк не совпало с тестовой матрицей i+j: %lld из %d, "
+                   "обработано элементов %lld из %lld, отпечаток %016llx\n",
+                   all[0], N, all[1], total_elements, (unsigned long long)fingerprint);
+            if (!sum_ok)
+                printf("Сумма %.17g отличается от ожидаемой %.17g больше допуска %g\n", sum, expected, tol);
+        }
+        ok = ok && sum_ok;
+    }
+    // Итог с учетом суммы знает только процесс 0 - иначе коды выхода процессов разойдутся
+    MPI_Bcast(&ok, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    return ok;
+}
+
+// pread, дочитывающий до конца (одно чтение может вернуть меньше запрошенного)
+static int pread_full(int fd, void *buf, size_t bytes, off_t offset) {
+    char *p = (char*)buf;
+    while (bytes > 0) {
+        ssize_t got = pread(fd, p, bytes, offset);
+        if (got <= 0) return -1;
+        p += got;
+        bytes -= (size_t)got;
+        offset += got;
+    }
+    return 0;
+}
+
+/*
+ * Запись тестовой матрицы N x M (i+j) в файл. Каждый процесс пишет свои строки порциями
+ * через MPI-IO, всю матрицу в памяти никто не держит. Возвращает 0 или код ошибки MPI
+ */
+static int generate_file(const char *path, int N, int M, int chunk_rows, MPI_Datatype row_type,
+                         int world_rank, int world_size) {
+    MPI_File fh;
+    int rc = MPI_File_open(MPI_COMM_WORLD, path, MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &fh);
+    if (rc != MPI_SUCCESS) return rc;
+    rc = MPI_File_set_size(fh, (MPI_Offset)N * M * sizeof(double));
+
+    // Свои строки - так же, как их раздал бы MPI_Scatterv
+    int *counts = (int*)malloc(world_size * sizeof(int));
+    int *displs = (int*)malloc(world_size * sizeof(int));
+    split_rows(N, world_size, counts, displs);
+    int my_rows = counts[world_rank], my_first = displs[world_rank];
+    int rows_per_write = chunk_rows < my_rows ? chunk_rows : my_rows;
+    double *buf = (double*)malloc(((size_t)rows_per_write * M + 1) * sizeof(double));
+
+    for (int done = 0; rc == MPI_SUCCESS && done < my_rows; done += rows_per_write) {
+        int rows = (my_rows - done < rows_per_write) ? my_rows - done : rows_per_write;
+        initialize_matrix(buf, my_first + done, rows, M);
+        rc = MPI_File_write_at(fh, (MPI_Offset)(my_first + done) * M * sizeof(double),
+                               buf, rows, row_type, MPI_STATUS_IGNORE);
+    }
+    MPI_File_close(&fh);
+    free(buf);
+    free(counts);
+    free(displs);
+
+    // Ошибка хотя бы у одного - ошибка у всех
+    int worst;
+    MPI_Allreduce(&rc, &worst, 1, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
+    return worst;
+}
+
+// Сколько времени процесс ждал данных и сколько считал
+typedef struct {
+    double wait_time;
+    double sum_time;
+} StreamStats;
+
+/*
+ * Процесс 0 читает файл (mmap или pread), порции по chunk_rows строк уходят через MPI_Iscatterv.
+ * Порция c+1 уже читается и раздается, пока все суммируют порцию c. Свои строки - в rd
+ */
+static void stream_root(const char *path, int mode, int N, int M, int chunk_rows, MPI_Datatype row_type,
+                        int world_rank, int world_size, Reducer *rd, StreamStats *st) {
+    int nchunks = (N + chunk_rows - 1) / chunk_rows;
+    size_t max_my_rows = (size_t)(chunk_rows / world_size + 1);
+    int *counts[2], *displs[2];
+    double *recv[2], *send[2] = {NULL, NULL};
+    MPI_Request req[2] = {MPI_REQUEST_NULL, MPI_REQUEST_NULL};
+    double *map = NULL;
+    size_t file_bytes = (size_t)N * M * sizeof(double);
+    int fd = -1;
+
+    // Массивы счетчиков нельзя менять, пока операция не завершилась - у каждого буфера свои
+    for (int b = 0; b < 2; b++) {
+        counts[b] = (int*)malloc(world_size * sizeof(int));
+        displs[b] = (int*)malloc(world_size * sizeof(int));
+        recv[b] = (double*)malloc(max_my_rows * M * sizeof(double));
+        if (recv[b] == NULL) {
+            fprintf(stderr, "Процесс %d: не хватает памяти под порцию\n", world_rank);
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+    }
+    if (world_rank == 0) {
+        fd = open(path, O_RDONLY);
+        if (fd < 0) {
+            perror(path);
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        if (mode == STREAM_MMAP) {
+            map = (double*)mmap(NULL, file_bytes, PROT_READ, MAP_SHARED, fd, 0);
+            if (map == MAP_FAILED) {
+                perror("mmap");
+                MPI_Abort(MPI_COMM_WORLD, 1);
+            }
+            // Читаем подряд: ядро подкачивает вперед и вытесняет уже пройденные страницы,
+            // так что файл больше памяти не вытесняет все остальное
+            madvise(map, file_bytes, MADV_SEQUENTIAL);
+        } else {
+            for (int b = 0; b < 2; b++) {
+                send[b] = (double*)malloc((size_t)chunk_rows * M * sizeof(double));
+                if (send[b] == NULL) {
+                    fprintf(stderr, "Процесс 0: не хватает памяти под порцию\n");
+                    MPI_Abort(MPI_COMM_WORLD, 1);
+                }
+            }
+        }
+    }
+
+    for (int c = -1; c < nchunks; c++) {
+        // Запускаем раздачу порции c+1 (на первом шаге - порции 0)
+        if (c + 1 < nchunks) {
+            int b = (c + 1) % 2;
+            int first = (c + 1) * chunk_rows;
+            int rows = (N - first < chunk_rows) ? N - first : chunk_rows;
+            const double *src = NULL;
+            split_rows(rows, world_size, counts[b], displs[b]);
+            if (world_rank == 0) {
+                if (mode == STREAM_MMAP) {
+                    src = map + (size_t)first * M;
+                } else {
+                    // Буфер send[b] освободился: раздача порции c-1 завершена на прошлом шаге
+                    if (pread_full(fd, send[b], (size_t)rows * M * sizeof(double),
+                                   (off_t)first * M * sizeof(double)) != 0) {
+                        fprintf(stderr, "Ошибка чтения %s\n", path);
+                        MPI_Abort(MPI_COMM_WORLD, 1);
+                    }
+                    src = send[b];
+                }
+            }
+            MPI_Iscatterv(src, counts[b], displs[b], row_type, recv[b], counts[b][world_rank], row_type,
+                          0, MPI_COMM_WORLD, &req[b]);
+        }
+        if (c < 0) continue;
+
+        // Дожидаемся порции c и суммируем ее, подталкивая раздачу следующей
+        int b = c % 2;
+        double t0 = MPI_Wtime();
+        MPI_Wait(&req[b], MPI_STATUS_IGNORE);
+        double t1 = MPI_Wtime();
+        reducer_rows(rd, recv[b], (long long)c * chunk_rows + displs[b][world_rank], counts[b][world_rank],
+                     &req[1 - b]);
+        st->wait_time += t1 - t0;
+        st->sum_time += MPI_Wtime() - t1;
+    }
+
+    if (map != NULL) munmap(map, file_bytes);
+    if (fd >= 0) close(fd);
+    for (int b = 0; b < 2; b++) {
+        free(counts[b]);
+        free(displs[b]);
+        free(recv[b]);
+        free(send[b]);
+    }
+}
+
+/*
+ * Каждый процесс сам читает свои строки каждой порции через MPI_File_iread_at;
+ * чтение порции c+1 идет, пока суммируется порция c
+ */
+static void stream_mpiio(MPI_File fh, int N, int M, int chunk_rows, MPI_Datatype row_type,
+                         int world_rank, int world_size, Reducer *rd, StreamStats *st) {
+    int nchunks = (N + chunk_rows - 1) / chunk_rows;
+    int *counts = (int*)malloc(world_size * sizeof(int));
+    int *displs = (int*)malloc(world_size * sizeof(int));
+    int my_rows[2] = {0, 0};
+    long long my_first[2] = {0, 0}; // номер моей первой строки порции во всей матрице
+    double *recv[2];
+    MPI_Request req[2] = {MPI_REQUEST_NULL, MPI_REQUEST_NULL};
+
+    for (int b = 0; b < 2; b++) {
+        recv[b] = (double*)malloc((size_t)(chunk_rows / world_size + 1) * M * sizeof(double));
+        if (recv[b] == NULL) {
+            fprintf(stderr, "Процесс %d: не хватает памяти под порцию\n", world_rank);
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+    }
+
+    for (int c = -1; c < nchunks; c++) {
+        if (c + 1 < nchunks) {
+            int b = (c + 1) % 2;
+            int first = (c + 1) * chunk_rows;
+            int rows = (N - first < chunk_rows) ? N - first : chunk_rows;
+            split_rows(rows, world_size, counts, displs);
+            my_rows[b] = counts[world_rank];
+            my_first[b] = (long long)first + displs[world_rank];
+            MPI_Offset offset = (MPI_Offset)my_first[b] * M * sizeof(double);
+            MPI_File_iread_at(fh, offset, recv[b], my_rows[b], row_type, &req[b]);
+        }
+        if (c < 0) continue;
+
+        int b = c % 2;
+        double t0 = MPI_Wtime();
+        MPI_Wait(&req[b], MPI_STATUS_IGNORE);
+        double t1 = MPI_Wtime();
+        reducer_rows(rd, recv[b], my_first[b], my_rows[b], &req[1 - b]);
+        st->wait_time += t1 - t0;
+        st->sum_time += MPI_Wtime() - t1;
+    }
+
+    free(counts);
+    free(displs);
+    free(recv[0]);
+    free(recv[1]);
+}
+
+/*
+ * Потоковый режим целиком: при необходимости создать файл, определить N по его размеру
+ * (если N = 0), сложить матрицу выбранным способом и напечатать итог
+ */
+static int reduce_file(const char *path, int generate, int mode, int kind, int verify, int N, int M,
+                       long chunk_bytes, int world_rank, int world_size) {
+    static const char *mode_names[] = {"mmap", "read", "mpiio"};
+    MPI_Datatype row_type;
+    MPI_Type_contiguous(M, MPI_DOUBLE, &row_type);
+    MPI_Type_commit(&row_type);
+
+    // Порция - целое число строк, не меньше одной строки на процесс
+    long row_bytes = (long)M * sizeof(double);
+    long chunk_rows_l = chunk_bytes / row_bytes;
+    if (chunk_rows_l < world_size) chunk_rows_l = world_size;
+    if (chunk_rows_l > 1073741824L) chunk_rows_l = 1073741824L;
+    int chunk_rows = (int)chunk_rows_l;
+
+    if (generate) {
+        double t = MPI_Wtime();
+        if (generate_file(path, N, M, chunk_rows, row_type, world_rank, world_size) != MPI_SUCCESS) {
+            if (world_rank == 0) fprintf(stderr, "Ошибка: не удалось записать %s\n", path);
+            MPI_Type_free(&row_type);
+            return 1;
+        }
+        if (world_rank == 0)
+            printf("Создан файл %s: %d x %d за %f с\n", path, N, M, MPI_Wtime() - t);
+    }
+
+    // Размер файла узнают все процессы сразу (открытие MPI-IO - коллективное)
+    MPI_File fh;
+    MPI_Offset file_size = 0;
+    if (MPI_File_open(MPI_COMM_WORLD, path, MPI_MODE_RDONLY, MPI_INFO_NULL, &fh) != MPI_SUCCESS) {
+        if (world_rank == 0) fprintf(stderr, "Ошибка: не удалось открыть %s\n", path);
+        MPI_Type_free(&row_type);
+        return 1;
+    }
+    MPI_File_get_size(fh, &file_size);
+    if (N == 0) {
+        long long rows = file_size / row_bytes;
+        N = (rows > 2147483647LL) ? -1 : (int)rows;
+    }
+    if (N < 1 || file_size % row_bytes != 0 || (MPI_Offset)N * row_bytes > file_size) {
+        if (world_rank == 0)
+            fprintf(stderr, "Ошибка: размер %s (%lld байт) не подходит для матрицы по %d столбцов\n",
+                    path, (long long)file_size, M);
+        MPI_File_close(&fh);
+        MPI_Type_free(&row_type);
+        return 1;
+    }
+    if (world_rank == 0)
+        printf("Запуск на %d процессах. Матрица %d x %d (%.1f МБ) из файла %s, чтение %s, порция %d строк\n",
+               world_size, N, M, (double)N * row_bytes / (1024.0 * 1024.0), path, mode_names[mode], chunk_rows);
+
+    StreamStats st = {0.0, 0.0};
+    Reducer rd;
+    reducer_init(&rd, kind, verify, M);
+    MPI_Barrier(MPI_COMM_WORLD);
+    double start_time = MPI_Wtime();
+    if (mode == STREAM_MPIIO) {
+        stream_mpiio(fh, N, M, chunk_rows, row_type, world_rank, world_size, &rd, &st);
+        MPI_File_close(&fh);
+    } else {
+        MPI_File_close(&fh);
+        stream_root(path, mode, N, M, chunk_rows, row_type, world_rank, world_size, &rd, &st);
+    }
+    MatrixStats total = reduce_and_report(&rd, world_rank);
+    double elapsed = MPI_Wtime() - start_time;
+    int ok = (verify == VERIFY_CHECKSUM) ? verify_results(&rd, &total, N, M, world_rank) : 1;
+    reducer_free(&rd);
+
+    // Время - по самому медленному процессу; ожидание данных - сколько чтение/раздача не успели
+    // спрятаться за суммированием
+    double times[3] = {elapsed, st.wait_time, st.sum_time}, max_times[3];
+    MPI_Reduce(times, max_times, 3, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+
+    if (world_rank == 0) {
+        printf("Время: %f с, %.1f МБ/с; ожидание данных до %f с, суммирование до %f с\n",
+               max_times[0], (double)N * row_bytes / (1024.0 * 1024.0) / max_times[0],
+               max_times[1], max_times[2]);
+    }
+    MPI_Type_free(&row_type);
+    return ok ? 0 : 1;
 }
 
 // Главная функция программы
@@ -37,21 +823,84 @@ int main(int argc, char** argv) {
     // Получаем "ранг" (уникальный ID от 0 до np-1) этого процесса
     MPI_Comm_rank(MPI_COMM_WORLD, &world_rank);
 
-    // Проверка входных данных
-    // Наша программа для простоты (из-за MPI_Scatter) требует,
-    // чтобы число строк (N) делилось нацело на число процессов.
-    if (N % world_size != 0) {
+    // Размер матрицы: ./lab5 [N] [M] [--sum=plain|pairwise|kahan] [--verify=checksum|serial|none]
+    //                          [--file=ПУТЬ [--generate] [--stream=mmap|read|mpiio] [--chunk=БАЙТ]]
+    const char *sizes[2] = {NULL, NULL};
+    const char *file_path = NULL;
+    int nsizes = 0, generate = 0, stream_mode = STREAM_MMAP, sum_kind = SUM_KAHAN, bad_args = 0;
+    int verify = -1; // не задано: выбирается ниже по тому, известны ли данные заранее
+    long chunk_bytes = DEFAULT_CHUNK_BYTES;
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--file=", 7) == 0) {
+            file_path = argv[i] + 7;
+        } else if (strcmp(argv[i], "--generate") == 0) {
+            generate = 1;
+        } else if (strcmp(argv[i], "--stream=mmap") == 0) {
+            stream_mode = STREAM_MMAP;
+        } else if (strcmp(argv[i], "--stream=read") == 0) {
+            stream_mode = STREAM_READ;
+        } else if (strcmp(argv[i], "--stream=mpiio") == 0) {
+            stream_mode = STREAM_MPIIO;
+        } else if (strcmp(argv[i], "--sum=plain") == 0) {
+            sum_kind = SUM_PLAIN;
+        } else if (strcmp(argv[i], "--sum=pairwise") == 0) {
+            sum_kind = SUM_PAIRWISE;
+        } else if (strcmp(argv[i], "--sum=kahan") == 0) {
+            sum_kind = SUM_KAHAN;
+        } else if (strcmp(argv[i], "--verify=checksum") == 0) {
+            verify = VERIFY_CHECKSUM;
+        } else if (strcmp(argv[i], "--verify=serial") == 0) {
+            verify = VERIFY_SERIAL;
+        } else if (strcmp(argv[i], "--verify=none") == 0) {
+            verify = VERIFY_NONE;
+        } else if (strncmp(argv[i], "--chunk=", 8) == 0) {
+            chunk_bytes = parse_bytes(argv[i] + 8);
+            if (chunk_bytes <= 0) bad_args = 1;
+        } else if (argv[i][0] != '-' && nsizes < 2) {
+            sizes[nsizes++] = argv[i];
+        } else {
+            bad_args = 1;
+        }
+    }
+    // С файлом N = 0 допустимо: число строк берется из размера файла
+    int N = parse_size(sizes[0], DEFAULT_N, (file_path != NULL && !generate) ? 0 : 1);
+    int M = parse_size(sizes[1], DEFAULT_M, 1);
+
+    // Контрольные суммы сверяются с матрицей i+j, а в готовом файле может быть что угодно
+    int foreign_file = (file_path != NULL && !generate);
+    if (verify < 0) verify = foreign_file ? VERIFY_NONE : VERIFY_CHECKSUM;
+
+    // Проверка входных данных.
+    // Делиться нацело на число процессов N больше не обязано: лишние строки
+    // раздаются по одной первым процессам (см. MPI_Scatterv ниже).
+    if (N < 0 || M < 0 || bad_args || (generate && file_path == NULL) ||
+        (verify == VERIFY_SERIAL && file_path != NULL) || (verify == VERIFY_CHECKSUM && foreign_file)) {
         
         // Только "главный" процесс (ранг 0) печатает ошибку,
         // чтобы избежать вывода N одинаковых ошибок.
         if (world_rank == 0) {
-            fprintf(stderr, "Ошибка: N (%d) должно делиться нацело на число процессов (%d)\n", N, world_size);
+            fprintf(stderr, "Ошибка: неверные аргументы (размеры - целые от 1 до 2147483647, с --file N может быть 0)\n");
+            fprintf(stderr, "Запуск: mpirun -np P %s [N] [M] [--sum=plain|pairwise|kahan] [--verify=checksum|serial|none]\n"
+                            "                    [--file=ПУТЬ [--generate] [--stream=mmap|read|mpiio] [--chunk=БАЙТ]]\n"
+                            "(--verify=serial - только без --file, --verify=checksum - без --file или с --generate)\n",
+                            argv[0]);
         }
         
         MPI_Finalize(); // Завершаем MPI
         return 1;       // Выходим с кодом ошибки
     }
 
+    // Потоковый режим: матрица в файле, в память целиком не загружается
+    if (file_path != NULL) {
+        int rc = reduce_file(file_path, generate, stream_mode, sum_kind, verify, N, M, chunk_bytes,
+                             world_rank, world_size);
+        MPI_Finalize();
+        return rc;
+    }
+
+    // Число элементов всей матрицы (может быть больше INT_MAX)
+    size_t total_elements = (size_t)N * (size_t)M;
+
     //Создание и инициализация данных (только на процессе 0)
 
     // Указатель на всю матрицу.
@@ -59,87 +908,121 @@ int main(int argc, char** argv) {
     double *global_matrix = NULL; 
 
     if (world_rank == 0) {
-        printf("Запуск на %d процессах. Размер матрицы: %d x %d\n", world_size, N, M);
+        printf("Запуск на %d процессах. Размер матрицы: %d x %d (%.1f МБ)\n", world_size, N, M,
+               total_elements * sizeof(double) / (1024.0 * 1024.0));
         
         // Выделяем память под всю матрицу N*M
-        global_matrix = (double*)malloc(N * M * sizeof(double));
+        global_matrix = (double*)malloc(total_elements * sizeof(double));
+        if (global_matrix == NULL) {
+            fprintf(stderr, "Ошибка: не хватает памяти под матрицу %d x %d\n", N, M);
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
         
         // Заполняем ее данными
-        initialize_matrix(global_matrix, N, M);
+        initialize_matrix(global_matrix, 0, N, M);
     }
 
+    // Тип "одна строка матрицы" - M подряд идущих double.
+    // Счетчики в MPI_Scatterv - int; если считать в строках, а не в элементах,
+    // то в int влезает кусок любого размера, хоть в десятки гигабайт.
+    MPI_Datatype row_type;
+    MPI_Type_contiguous(M, MPI_DOUBLE, &row_type);
+    MPI_Type_commit(&row_type);
+
     // Расчет размеров "кусков" для каждого процесса
     
-    // (N / world_size) -> сколько строк достанется каждому
-    // Пример: 8 строк / 4 процесса = 2 строки на процесс
-    int rows_per_proc = N / world_size;
+    // (N / world_size) -> сколько строк достанется каждому,
+    // (N % world_size) -> сколько строк осталось; их получают первые процессы, по одной.
+    // Пример: 10 строк / 4 процесса -> 3, 3, 2, 2 строки
+    int *send_counts = (int*)malloc(world_size * sizeof(int)); // строк каждому процессу
+    int *displs = (int*)malloc(world_size * sizeof(int));      // с какой строки начинается его кусок
+    int offset = 0;
+    for (int p = 0; p < world_size; p++) {
+        send_counts[p] = N / world_size + (p < N % world_size ? 1 : 0);
+        displs[p] = offset;
+        offset += send_counts[p];
+    }
+    int rows_per_proc = send_counts[world_rank];
     
-    // (rows_per_proc * M) -> сколько *элементов* в куске
-    // Пример: 2 строки * 10 столбцов = 20 элементов на процесс
-    int elements_per_proc = rows_per_proc * M;
+    // (rows_per_proc * M) -> сколько *элементов* в моем куске
+    // Пример: 3 строки * 10 столбцов = 30 элементов
+    size_t elements_per_proc = (size_t)rows_per_proc * M;
 
     // Выделение локальной памяти
     
     // каждый  процесс (включая 0) выделяет память
     // только для своего  маленького куска
-    double *local_chunk = (double*)malloc(elements_per_proc * sizeof(double));
+    // (при N < world_size кусок бывает пустым - выделяем хотя бы один элемент)
+    double *local_chunk = (double*)malloc((elements_per_proc > 0 ? elements_per_proc : 1) * sizeof(double));
+    if (local_chunk == NULL) {
+        fprintf(stderr, "Процесс %d: не хватает памяти под %d строк\n", world_rank, rows_per_proc);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
 
-    // Распределение работы (Scatter)
+    // Распределение работы (Scatterv)
     
-    // MPI_Scatter - коллективная операция.
+    // MPI_Scatterv - коллективная операция, как MPI_Scatter,
+    // но куски могут быть разного размера.
     // Процесс 0 "нарезает" global_matrix и "раздает" куски всем.
-    MPI_Scatter(
+    double start_time = MPI_Wtime();
+    MPI_Scatterv(
         global_matrix,      // Указатель на все данные (только у rank 0)
-        elements_per_proc,  // *Сколько* элементов отправить *каждому*
-        MPI_DOUBLE,         // Тип данных
+        send_counts,        // *Сколько* строк отправить *каждому*
+        displs,             // С какой строки начинается кусок каждого
+        row_type,           // Тип данных - строка целиком
         local_chunk,        // *Куда* принять свою часть (у *каждого* процесса)
-        elements_per_proc,  // *Сколько* элементов *я* принимаю
-        MPI_DOUBLE,         // Тип данных
+        rows_per_proc,      // *Сколько* строк *я* принимаю
+        row_type,           // Тип данных
         0,                  // Ранг процесса-отправителя (root)
         MPI_COMM_WORLD      // Коммуникатор
     );
-    // После этого у rank 0 в local_chunk лежат строки 0-1,
-    // у rank 1 - строки 2-3, у rank 2 - строки 4-5, и т.д.
+    double scatter_time = MPI_Wtime() - start_time;
+    // После этого у rank 0 в local_chunk лежат строки 0-2,
+    // у rank 1 - строки 3-5, у rank 2 - строки 6-7, и т.д.
 
     // Локальные вычисления (Параллельная часть)
     
-    // каждый процесс независимо считает сумму *только* своего куска
-    double local_sum = 0.0;
-    for (int i = 0; i < elements_per_proc; i++) {
-        local_sum += local_chunk[i];
-    }
-    // Теперь у rank 0 есть сумма строк 0-1, у rank 1 - сумма строк 2-3...
-
-    // Переменная для хранения итоговой суммы (будет заполнена только у rank 0)
-    double global_sum = 0.0;
+    // каждый процесс независимо считает сумму (и остальную статистику) *только* своего куска
+    start_time = MPI_Wtime();
+    Reducer rd;
+    reducer_init(&rd, sum_kind, verify, M);
+    reducer_rows(&rd, local_chunk, displs[world_rank], rows_per_proc, NULL);
+    // Теперь у rank 0 есть сумма строк 0-2, у rank 1 - сумма строк 3-5...
 
     // Сбор результатов (Reduce)
     
     // MPI_Reduce - коллективная операция.
-    // Все процессы "отправляют" свой local_sum процессу 0.
-    // Процесс 0 "собирает" их и выполняет операцию MPI_SUM.
-    MPI_Reduce(
-        &local_sum,         // Указатель на мои данные для отправки
-        &global_sum,        // Указатель на итог (заполняется только у rank 0)
-        1,                  // Количество элементов (мы отправляем 1 число)
-        MPI_DOUBLE,         // Тип данных
-        MPI_SUM,            // Операция (сложить все полученные local_sum)
-        0,                  // Ранг процесса-получателя (root)
-        MPI_COMM_WORLD      // Коммуникатор
-    );
+    // Все процессы "отправляют" свою статистику процессу 0, а он складывает ее
+    // пользовательской операцией: суммы - с поправкой, минимумы - минимумом и т.д.
+    // Процесс 0 печатает итог.
+    MatrixStats total = reduce_and_report(&rd, world_rank);
+    double reduce_time = MPI_Wtime() - start_time;
+
+    // Проверка по контрольным суммам: каждый процесс уже проверил свои строки в том же проходе,
+    // осталось сложить счетчики (MPI_Allreduce). Второго прохода по всей матрице на процессе 0 нет
+    int ok = (verify == VERIFY_CHECKSUM) ? verify_results(&rd, &total, N, M, world_rank) : 1;
+    reducer_free(&rd);
+
+    // Время - по самому медленному процессу: все ждут его в коллективных операциях
+    double times[2] = {scatter_time, reduce_time}, max_times[2];
+    MPI_Reduce(times, max_times, 2, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
 
     // Вывод и очистка
     
     // Только rank 0 выводит результат и выполняет проверку
     if (world_rank == 0) {
-        printf("Общая параллельная сумма: %f\n", global_sum);
-
         // --- Проверка (считаем то же самое, но в 1 поток) ---
-        double serial_sum = 0.0;
-        for (int i = 0; i < N * M; i++) {
-            serial_sum += global_matrix[i];
+        // Только по --verify=serial: это O(N*M) на одном процессе и второй проход по памяти
+        if (verify == VERIFY_SERIAL) {
+            double serial_sum = 0.0;
+            for (size_t i = 0; i < total_elements; i++) {
+                serial_sum += global_matrix[i];
+            }
+            printf("Общая последовательная сумма (для проверки): %.17g\n", serial_sum);
         }
-        printf("Общая последовательная сумма (для проверки): %f\n", serial_sum);
+        printf("Время раздачи (Scatterv): %f с, %.1f МБ/с\n", max_times[0],
+               max_times[0] > 0 ? total_elements * sizeof(double) / (1024.0 * 1024.0) / max_times[0] : 0.0);
+        printf("Время суммирования и сбора (Reduce): %f с\n", max_times[1]);
 
         // Только rank 0 освобождает память из-под *всей* матрицы
         free(global_matrix);
@@ -147,9 +1030,12 @@ int main(int argc, char** argv) {
 
     // каждый  процесс освобождает память из-под своего куска
     free(local_chunk);
+    free(send_counts);
+    free(displs);
+    MPI_Type_free(&row_type);
 
     // Завершение MPI. Обязательный вызов.
     MPI_Finalize();
 
-    return 0; // Успешный выход
+    return ok ? 0 : 1; // Успешный выход (или 1, если проверка не прошла)
 }
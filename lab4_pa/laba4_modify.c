@@ -1,8 +1,451 @@
 #include <mpi.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <math.h>
 #include <time.h>
 
+/*
+ * Замер редукции MPI_MIN на коммуникаторе четных процессов (MPI_Comm_split, как в laba4.c).
+ * Размер вектора float растет вдвое от --min до N, для каждого размера сравниваются:
+ *   reduce       - MPI_Reduce
+ *   allreduce    - MPI_Allreduce (результат у всех)
+ *   ireduce      - MPI_Ireduce + MPI_Wait
+ *   binomial     - вручную: биномиальное дерево, log2(P) шагов по всему вектору
+ *   rabenseifner - вручную: reduce-scatter рекурсивным делением пополам + сборка деревом
+ *   ring         - вручную: reduce-scatter по кольцу (P-1 шагов по 1/P вектора) + MPI_Gatherv
+ * Каждый замер: прогрев, затем столько повторов, чтобы набрать --time секунд (от MIN_REPS
+ * до MAX_REPS). Время повтора - по самому медленному процессу; печатаются мин/медиана/макс,
+ * звездочка - лучший по медиане для этого размера. Результат каждого способа сверяется с MPI_Reduce.
+ *
+ * --overlap - вместо перебора размеров: можно ли спрятать редукцию N float за счетом.
+ * Вектор режется на S сегментов; сегмент k запускается MPI_Ireduce (или постоянным запросом
+ * MPI_Reduce_init с --persistent, если MPI >= 4), затем идет k-я доля синтетического счета,
+ * во время которого запущенные редукции подталкиваются MPI_Testall каждые --poll мкс.
+ * Для каждого S замеряются: только связь, только счет, вместе; перекрытие =
+ * (связь + счет - вместе) / min(связь, счет): 100% - меньшая часть спрятана целиком.
+ * Объем счета --compute мкс (по умолчанию - время одной MPI_Ireduce всего вектора).
+ *
+ * Запуск: mpirun -np 16 ./laba4_modify [N] [--min=1] [--time=0.2] [--algo=reduce,ring,...]
+ *         mpirun -np 16 ./laba4_modify [N] --overlap [--segments=1,2,4,8] [--compute=МКС] [--poll=20]
+ *                                          [--persistent]
+ */
+
+#define MIN_REPS 5
+#define MAX_REPS 1000
+#define WARMUP 3
+#define TAG 0
+#define MAX_SEG_LIST 32 // значений в --segments
+
+// Способы редукции
+enum { ALG_REDUCE, ALG_ALLREDUCE, ALG_IREDUCE, ALG_BINOMIAL, ALG_RABENSEIFNER, ALG_RING, NUM_ALGS };
+static const char *alg_names[NUM_ALGS] = {"reduce", "allreduce", "ireduce", "binomial", "rabenseifner", "ring"};
+
+// Буферы, общие для всех способов (выделяются один раз под наибольший размер)
+typedef struct {
+    float *data;   // свои данные
+    float *result; // итог (значим на процессе 0)
+    float *acc;    // рабочая копия для ручных алгоритмов
+    float *tmp;    // прием от партнера
+    int *counts, *displs; // раскладка вектора на блоки по процессам
+} Buffers;
+
+// a[i] = min(a[i], b[i])
+static void min_into(float *a, const float *b, int n) {
+    for (int i = 0; i < n; i++) a[i] = b[i] < a[i] ? b[i] : a[i];
+}
+
+// Раскладка n элементов на p блоков: по n / p, остаток - первым
+static void split_blocks(int n, int p, int *counts, int *displs) {
+    int offset = 0;
+    for (int i = 0; i < p; i++) {
+        counts[i] = n / p + (i < n % p ? 1 : 0);
+        displs[i] = offset;
+        offset += counts[i];
+    }
+}
+
+// Биномиальное дерево к процессу 0: на шаге mask процесс с битом mask отдает накопленное и выходит
+static void reduce_binomial(Buffers *b, int n, MPI_Comm comm, int rank, int size) {
+    memcpy(b->acc, b->data, n * sizeof(float));
+    for (int mask = 1; mask < size; mask <<= 1) {
+        if (rank & mask) {
+            MPI_Send(b->acc, n, MPI_FLOAT, rank - mask, TAG, comm);
+            return;
+        }
+        if (rank + mask < size) {
+            MPI_Recv(b->tmp, n, MPI_FLOAT, rank + mask, TAG, comm, MPI_STATUS_IGNORE);
+            min_into(b->acc, b->tmp, n);
+        }
+    }
+    memcpy(b->result, b->acc, n * sizeof(float));
+}
+
+/*
+ * Рабенсейфнер: reduce-scatter рекурсивным делением пополам (каждый шаг - обмен половиной
+ * текущего отрезка), затем сборка отрезков деревом к процессу 0. Пересылается ~2n вместо n*log2(P).
+ * Если P не степень двойки, первые 2*rem процессов сначала сливаются парами: четный отдает
+ * весь вектор нечетному и дальше не участвует
+ */
+static void reduce_rabenseifner(Buffers *b, int n, MPI_Comm comm, int rank, int size) {
+    int p2 = 1;
+    while (p2 * 2 <= size) p2 *= 2;
+    int rem = size - p2;
+
+    memcpy(b->acc, b->data, n * sizeof(float));
+    int vrank; // номер среди p2 участников, -1 - выбыл
+    if (rank < 2 * rem) {
+        if (rank % 2 == 0) {
+            MPI_Send(b->acc, n, MPI_FLOAT, rank + 1, TAG, comm);
+            vrank = -1;
+        } else {
+            MPI_Recv(b->tmp, n, MPI_FLOAT, rank - 1, TAG, comm, MPI_STATUS_IGNORE);
+            min_into(b->acc, b->tmp, n);
+            vrank = rank / 2;
+        }
+    } else {
+        vrank = rank - rem;
+    }
+    // Настоящий ранг участника с номером v
+    #define REAL_RANK(v) ((v) < rem ? 2 * (v) + 1 : (v) + rem)
+
+    if (vrank >= 0) {
+        split_blocks(n, p2, b->counts, b->displs);
+
+        // Reduce-scatter: отрезок блоков [lo, hi) делится пополам, пока не останется блок vrank
+        int lo = 0, hi = p2;
+        for (int mask = p2 / 2; mask > 0; mask >>= 1) {
+            int partner = REAL_RANK(vrank ^ mask), mid = lo + (hi - lo) / 2;
+            int keep_lo, keep_hi, send_lo, send_hi;
+            if (vrank & mask) { keep_lo = mid; keep_hi = hi; send_lo = lo; send_hi = mid; }
+            else              { keep_lo = lo; keep_hi = mid; send_lo = mid; send_hi = hi; }
+            int send_n = b->displs[send_hi - 1] + b->counts[send_hi - 1] - b->displs[send_lo];
+            int keep_n = b->displs[keep_hi - 1] + b->counts[keep_hi - 1] - b->displs[keep_lo];
+            MPI_Sendrecv(b->acc + b->displs[send_lo], send_n, MPI_FLOAT, partner, TAG,
+                         b->tmp, keep_n, MPI_FLOAT, partner, TAG, comm, MPI_STATUS_IGNORE);
+            min_into(b->acc + b->displs[keep_lo], b->tmp, keep_n);
+            lo = keep_lo;
+            hi = keep_hi;
+        }
+
+        // Сборка: на шаге mask процесс держит блоки [vrank, vrank + mask) и либо отдает их
+        // партнеру vrank - mask, либо принимает следующие mask блоков
+        for (int mask = 1; mask < p2; mask <<= 1) {
+            int first = b->displs[vrank];
+            if (vrank & mask) {
+                int last = vrank + mask - 1;
+                MPI_Send(b->acc + first, b->displs[last] + b->counts[last] - first, MPI_FLOAT,
+                         REAL_RANK(vrank - mask), TAG, comm);
+                break;
+            }
+            int from = vrank + mask, last = vrank + 2 * mask - 1;
+            MPI_Recv(b->acc + b->displs[from], b->displs[last] + b->counts[last] - b->displs[from], MPI_FLOAT,
+                     REAL_RANK(from), TAG, comm, MPI_STATUS_IGNORE);
+        }
+    }
+
+    // Итог у участника 0; при rem > 0 это процесс 1, он передает итог процессу 0
+    if (REAL_RANK(0) != 0) {
+        if (rank == REAL_RANK(0)) MPI_Send(b->acc, n, MPI_FLOAT, 0, TAG, comm);
+        if (rank == 0) MPI_Recv(b->result, n, MPI_FLOAT, REAL_RANK(0), TAG, comm, MPI_STATUS_IGNORE);
+    } else if (rank == 0) {
+        memcpy(b->result, b->acc, n * sizeof(float));
+    }
+    #undef REAL_RANK
+}
+
+/*
+ * Кольцо: на шаге s процесс отдает следующему блок (rank - s) и сливает в себя блок (rank - s - 1)
+ * от предыдущего. После P-1 шагов блок (rank + 1) mod P у процесса готов, MPI_Gatherv собирает блоки
+ */
+static void reduce_ring(Buffers *b, int n, MPI_Comm comm, int rank, int size) {
+    int next = (rank + 1) % size, prev = (rank - 1 + size) % size;
+    memcpy(b->acc, b->data, n * sizeof(float));
+    split_blocks(n, size, b->counts, b->displs);
+    for (int s = 0; s < size - 1; s++) {
+        int send_blk = (rank - s + size) % size, recv_blk = (rank - s - 1 + size) % size;
+        MPI_Sendrecv(b->acc + b->displs[send_blk], b->counts[send_blk], MPI_FLOAT, next, TAG,
+                     b->tmp, b->counts[recv_blk], MPI_FLOAT, prev, TAG, comm, MPI_STATUS_IGNORE);
+        min_into(b->acc + b->displs[recv_blk], b->tmp, b->counts[recv_blk]);
+    }
+
+    // Процесс r держит блок (r + 1) mod P: для Gatherv сдвигаем раскладку на один
+    int *rcounts = b->counts + size, *rdispls = b->displs + size;
+    for (int r = 0; r < size; r++) {
+        rcounts[r] = b->counts[(r + 1) % size];
+        rdispls[r] = b->displs[(r + 1) % size];
+    }
+    int mine = (rank + 1) % size;
+    MPI_Gatherv(b->acc + b->displs[mine], b->counts[mine], MPI_FLOAT,
+                b->result, rcounts, rdispls, MPI_FLOAT, 0, comm);
+}
+
+// Одна редукция n элементов выбранным способом; итог - в b->result на процессе 0
+static void run_alg(int alg, Buffers *b, int n, MPI_Comm comm, int rank, int size) {
+    MPI_Request req;
+    switch (alg) {
+    case ALG_REDUCE:
+        MPI_Reduce(b->data, b->result, n, MPI_FLOAT, MPI_MIN, 0, comm);
+        break;
+    case ALG_ALLREDUCE:
+        MPI_Allreduce(b->data, b->result, n, MPI_FLOAT, MPI_MIN, comm);
+        break;
+    case ALG_IREDUCE:
+        MPI_Ireduce(b->data, b->result, n, MPI_FLOAT, MPI_MIN, 0, comm, &req);
+        MPI_Wait(&req, MPI_STATUS_IGNORE);
+        break;
+    case ALG_BINOMIAL:
+        reduce_binomial(b, n, comm, rank, size);
+        break;
+    case ALG_RABENSEIFNER:
+        reduce_rabenseifner(b, n, comm, rank, size);
+        break;
+    default:
+        reduce_ring(b, n, comm, rank, size);
+        break;
+    }
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+// Заполнение результата NaN перед замером: способ, который ничего не записал
+// (или записал не все блоки), не пройдет проверку на остатках от предыдущего
+static void poison_result(float *result, int n) {
+    for (int i = 0; i < n; i++) result[i] = NAN;
+}
+
+// Один замеряемый вызов
+typedef void (*BenchFn)(void *ctx);
+
+/*
+ * Замер fn: прогрев WARMUP вызовов, по нему процесс 0 выбирает число повторов под target секунд
+ * (от MIN_REPS до MAX_REPS), затем повторы через барьер. Время повтора - по самому медленному
+ * процессу (один Reduce на весь замер). Мин/медиана/макс получают все процессы; возвращает число повторов
+ */
+static int measure(BenchFn fn, void *ctx, MPI_Comm comm, int rank, double target,
+                   double *mn, double *med, double *mx) {
+    static double times[MAX_REPS], max_times[MAX_REPS];
+
+    MPI_Barrier(comm);
+    double t0 = MPI_Wtime();
+    for (int w = 0; w < WARMUP; w++) fn(ctx);
+    double per_call = (MPI_Wtime() - t0) / WARMUP;
+    int reps = (per_call > 0) ? (int)(target / per_call) : MAX_REPS;
+    if (reps < MIN_REPS) reps = MIN_REPS;
+    if (reps > MAX_REPS) reps = MAX_REPS;
+    MPI_Bcast(&reps, 1, MPI_INT, 0, comm);
+
+    for (int r = 0; r < reps; r++) {
+        MPI_Barrier(comm);
+        double start = MPI_Wtime();
+        fn(ctx);
+        times[r] = MPI_Wtime() - start;
+    }
+    MPI_Reduce(times, max_times, reps, MPI_DOUBLE, MPI_MAX, 0, comm);
+
+    double stats[3];
+    if (rank == 0) {
+        qsort(max_times, reps, sizeof(double), cmp_double);
+        stats[0] = max_times[0];
+        // Число повторов подбирается и часто четное: тогда медиана - среднее двух средних
+        stats[1] = (reps % 2) ? max_times[reps / 2] : 0.5 * (max_times[reps / 2 - 1] + max_times[reps / 2]);
+        stats[2] = max_times[reps - 1];
+    }
+    MPI_Bcast(stats, 3, MPI_DOUBLE, 0, comm);
+    *mn = stats[0];
+    *med = stats[1];
+    *mx = stats[2];
+    return reps;
+}
+
+// Замер одного способа из перебора
+typedef struct {
+    int alg;
+    Buffers *b;
+    int n;
+    MPI_Comm comm;
+    int rank, size;
+} AlgRun;
+
+static void alg_fn(void *ctx) {
+    AlgRun *a = (AlgRun*)ctx;
+    run_alg(a->alg, a->b, a->n, a->comm, a->rank, a->size);
+}
+
+// Результат синтетического счета - чтобы компилятор его не выбросил
+static volatile double compute_sink;
+
+/*
+ * Синтетический счет: iters шагов зависимой цепочки умножений-сложений (только процессор,
+ * без памяти). Каждые poll шагов - MPI_Testall по nreqs запущенным редукциям: без этого
+ * многие реализации MPI не двигают неблокирующие коллективные операции, пока мы считаем
+ */
+static void synthetic_compute(long iters, long poll, MPI_Request *reqs, int nreqs) {
+    double x = compute_sink;
+    for (long done = 0; done < iters; done += poll) {
+        long end = (iters - done < poll) ? iters - done : poll;
+        for (long i = 0; i < end; i++) x = x * 0.9999999 + 1e-7;
+        if (nreqs > 0) {
+            int flag;
+            MPI_Testall(nreqs, reqs, &flag, MPI_STATUSES_IGNORE);
+        }
+    }
+    compute_sink = x;
+}
+
+// Конвейер редукции по сегментам вперемешку со счетом
+typedef struct {
+    Buffers *b;
+    MPI_Comm comm;
+    int segments;
+    int *seg_counts, *seg_displs;
+    MPI_Request *reqs;
+    int persistent;      // запросы созданы MPI_Reduce_init и запускаются MPI_Start
+    int do_comm, do_comp; // что делать в этом замере
+    long work, poll;     // шагов счета на весь вектор и между MPI_Testall
+} OverlapRun;
+
+static void overlap_fn(void *ctx) {
+    OverlapRun *o = (OverlapRun*)ctx;
+    if (!o->persistent)
+        for (int k = 0; k < o->segments; k++) o->reqs[k] = MPI_REQUEST_NULL;
+    for (int k = 0; k < o->segments; k++) {
+        if (o->do_comm) {
+            if (o->persistent) {
+                MPI_Start(&o->reqs[k]);
+            } else {
+                MPI_Ireduce(o->b->data + o->seg_displs[k], o->b->result + o->seg_displs[k], o->seg_counts[k],
+                            MPI_FLOAT, MPI_MIN, 0, o->comm, &o->reqs[k]);
+            }
+        }
+        if (o->do_comp) {
+            // Доля счета на сегмент; остаток - последнему
+            long part = o->work / o->segments + (k == o->segments - 1 ? o->work % o->segments : 0);
+            synthetic_compute(part, o->poll, o->reqs, o->do_comm ? k + 1 : 0);
+        }
+    }
+    if (o->do_comm) MPI_Waitall(o->segments, o->reqs, MPI_STATUSES_IGNORE);
+}
+
+/*
+ * Режим --overlap: для каждого числа сегментов - связь, счет и вместе, и какая доля меньшей
+ * из двух частей спряталась за большей
+ */
+static void overlap_bench(Buffers *b, const float *reference, int n, MPI_Comm comm, int rank,
+                          const int *segs, int nsegs, double compute_us, double poll_us,
+                          int persistent, double target) {
+    double mn, med, mx;
+    OverlapRun o;
+    memset(&o, 0, sizeof(o));
+    o.b = b;
+    o.comm = comm;
+    // Массивы сегментов - под самое большое S из списка (больше n сегментов не бывает)
+    int max_segs = 1;
+    for (int si = 0; si < nsegs; si++)
+        if (segs[si] > max_segs) max_segs = segs[si];
+    if (max_segs > n) max_segs = n;
+    o.seg_counts = (int*)malloc(max_segs * sizeof(int));
+    o.seg_displs = (int*)malloc(max_segs * sizeof(int));
+    o.reqs = (MPI_Request*)malloc(max_segs * sizeof(MPI_Request));
+
+    // Калибровка счета на процессе 0: у всех должна быть одинаковая работа
+    double steps_per_us = 0.0;
+    if (rank == 0) {
+        long k = 1L << 22;
+        double t0 = MPI_Wtime();
+        synthetic_compute(k, k, NULL, 0);
+        steps_per_us = k / ((MPI_Wtime() - t0) * 1e6);
+    }
+    MPI_Bcast(&steps_per_us, 1, MPI_DOUBLE, 0, comm);
+
+    // Объем счета по умолчанию - сколько идет одна редукция всего вектора
+    if (compute_us <= 0) {
+        o.segments = 1;
+        o.seg_counts[0] = n;
+        o.seg_displs[0] = 0;
+        o.do_comm = 1;
+        measure(overlap_fn, &o, comm, rank, target, &mn, &med, &mx);
+        compute_us = med * 1e6;
+    }
+    o.work = (long)(compute_us * steps_per_us);
+    o.poll = (long)(poll_us * steps_per_us);
+    if (o.poll < 1) o.poll = 1;
+
+    if (rank == 0) {
+        printf("Перекрытие редукции %d float со счетом %.1f мкс (MPI_Testall каждые %.1f мкс), %s\n",
+               n, compute_us, poll_us, persistent ? "MPI_Reduce_init + MPI_Start" : "MPI_Ireduce");
+        // Заголовок выровнен вручную: printf считает ширину в байтах, а кириллица - два байта на букву
+        printf("  сегм.   связь, мкс    счет, мкс  вместе, мкс  перекрытие  проверка\n");
+    }
+
+    double best = -1.0;
+    int best_segs = 0, prev_S = 0;
+    for (int si = 0; si < nsegs; si++) {
+        int S = segs[si] < n ? segs[si] : n;
+        if (S == prev_S) continue; // после обрезки до n одно и то же S не замеряем дважды
+        prev_S = S;
+        o.segments = S;
+        for (int k = 0, offset = 0; k < S; k++) {
+            o.seg_counts[k] = n / S + (k < n % S ? 1 : 0);
+            o.seg_displs[k] = offset;
+            offset += o.seg_counts[k];
+        }
+        o.persistent = 0;
+#if MPI_VERSION >= 4
+        // Постоянные коллективные запросы: разбор аргументов и выбор алгоритма - один раз, здесь
+        if (persistent) {
+            for (int k = 0; k < S; k++)
+                MPI_Reduce_init(b->data + o.seg_displs[k], b->result + o.seg_displs[k], o.seg_counts[k],
+                                MPI_FLOAT, MPI_MIN, 0, comm, MPI_INFO_NULL, &o.reqs[k]);
+            o.persistent = 1;
+        }
+#endif
+        double t_comm, t_comp, t_both;
+        o.do_comm = 1; o.do_comp = 0;
+        measure(overlap_fn, &o, comm, rank, target, &mn, &t_comm, &mx);
+        o.do_comm = 0; o.do_comp = 1;
+        measure(overlap_fn, &o, comm, rank, target, &mn, &t_comp, &mx);
+        poison_result(b->result, n);
+        o.do_comm = 1; o.do_comp = 1;
+        measure(overlap_fn, &o, comm, rank, target, &mn, &t_both, &mx);
+
+        if (o.persistent)
+            for (int k = 0; k < S; k++) MPI_Request_free(&o.reqs[k]);
+
+        if (rank == 0) {
+            int bad = 0;
+            for (int i = 0; i < n; i++)
+                if (b->result[i] != reference[i]) bad++;
+            double hidden = t_comm + t_comp - t_both;
+            double shorter = t_comm < t_comp ? t_comm : t_comp;
+            double overlap = shorter > 0 ? hidden / shorter : 0.0;
+            if (overlap < 0) overlap = 0;
+            if (overlap > 1) overlap = 1;
+            if (overlap > best) {
+                best = overlap;
+                best_segs = S;
+            }
+            char check[32];
+            if (bad) snprintf(check, sizeof(check), "%d ошибок", bad);
+            else snprintf(check, sizeof(check), "OK");
+            printf("%7d %12.1f %12.1f %12.1f %10.0f%% %9s\n", S, t_comm * 1e6, t_comp * 1e6, t_both * 1e6,
+                   overlap * 100, check);
+        }
+    }
+    if (rank == 0) {
+        printf("Лучшее перекрытие: %.0f%% при %d сегментах - ", best * 100, best_segs);
+        if (best >= 0.8) printf("редукцию можно спрятать за счетом\n");
+        else if (best >= 0.3) printf("редукция прячется за счетом частично\n");
+        else printf("редукция за счетом не прячется (MPI не двигает ее в фоне или процессы делят ядра)\n");
+    }
+    free(o.seg_counts);
+    free(o.seg_displs);
+    free(o.reqs);
+}
+
 int main(int argc, char** argv) {
     MPI_Init(&argc, &argv);
 
@@ -11,17 +454,62 @@ int main(int argc, char** argv) {
     MPI_Comm_rank(comm, &rank);
     MPI_Comm_size(comm, &size);
 
-    int N = (argc > 1) ? atoi(argv[1]) : 3;
-    float *data = NULL;
-    if (rank % 2 == 0) {
-        data = (float*)malloc(N * sizeof(float));
-        srand(time(NULL) + rank);
-        for (int i = 0; i < N; i++) {
-            data[i] = (float)(rand() % 100);
+    // Параметры: N - наибольший размер вектора (элементов float)
+    int N = 1 << 20, min_n = 1;
+    double target = 0.2; // секунд на один замер
+    int algs[NUM_ALGS] = {1, 1, 1, 1, 1, 1};
+    int overlap = 0, persistent = 0;
+    int segs[MAX_SEG_LIST] = {1, 2, 4, 8, 16, 32}, nsegs = 6;
+    double compute_us = 0.0, poll_us = 20.0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--overlap") == 0) {
+            overlap = 1;
+        } else if (strcmp(argv[i], "--persistent") == 0) {
+            persistent = 1;
+        } else if (strncmp(argv[i], "--compute=", 10) == 0) {
+            compute_us = atof(argv[i] + 10);
+        } else if (strncmp(argv[i], "--poll=", 7) == 0) {
+            poll_us = atof(argv[i] + 7);
+        } else if (strncmp(argv[i], "--segments=", 11) == 0) {
+            nsegs = 0;
+            char *list = strdup(argv[i] + 11), *save = NULL;
+            for (char *v = strtok_r(list, ",", &save); v && nsegs < MAX_SEG_LIST; v = strtok_r(NULL, ",", &save))
+                if (atoi(v) > 0) segs[nsegs++] = atoi(v);
+            free(list);
+            if (nsegs == 0) segs[nsegs++] = 1;
+        } else if (strncmp(argv[i], "--min=", 6) == 0) {
+            min_n = atoi(argv[i] + 6);
+        } else if (strncmp(argv[i], "--time=", 7) == 0) {
+            target = atof(argv[i] + 7);
+        } else if (strncmp(argv[i], "--algo=", 7) == 0) {
+            // Список через запятую
+            for (int k = 0; k < NUM_ALGS; k++) algs[k] = 0;
+            char *list = strdup(argv[i] + 7), *save = NULL;
+            for (char *name = strtok_r(list, ",", &save); name; name = strtok_r(NULL, ",", &save)) {
+                int found = 0;
+                for (int k = 0; k < NUM_ALGS; k++)
+                    if (strcmp(name, alg_names[k]) == 0) algs[k] = found = 1;
+                if (!found && rank == 0) fprintf(stderr, "Предупреждение: неизвестный способ %s\n", name);
+            }
+            free(list);
+        } else if (argv[i][0] != '-') {
+            N = atoi(argv[i]);
+        } else if (rank == 0) {
+            fprintf(stderr, "Предупреждение: неизвестный аргумент %s\n", argv[i]);
         }
-        // printf skipped for timing
     }
+    if (N < 1) N = 1;
+    if (min_n < 1) min_n = 1;
+    if (min_n > N) min_n = N;
+    if (poll_us <= 0) poll_us = 20.0;
+#if MPI_VERSION < 4
+    if (persistent && rank == 0)
+        fprintf(stderr, "Предупреждение: MPI_Reduce_init есть только в MPI 4 (здесь MPI %d), "
+                        "используется MPI_Ireduce\n", MPI_VERSION);
+    persistent = 0;
+#endif
 
+    // Коммуникатор четных процессов
     int color = (rank % 2 == 0) ? 0 : MPI_UNDEFINED;
     MPI_Comm newcomm;
     MPI_Comm_split(comm, color, rank, &newcomm);
@@ -29,32 +517,76 @@ int main(int argc, char** argv) {
     if (newcomm != MPI_COMM_NULL) {
         int newrank, newsize;
         MPI_Comm_rank(newcomm, &newrank);
+        MPI_Comm_size(newcomm, &newsize);
 
-        float *min_data = NULL;
-        if (newrank == 0) min_data = (float*)malloc(N * sizeof(float));
-
-        double start_time, end_time;
-        if (newrank == 0) start_time = MPI_Wtime();
+        Buffers b;
+        b.data = (float*)malloc(N * sizeof(float));
+        b.result = (float*)malloc(N * sizeof(float));
+        b.acc = (float*)malloc(N * sizeof(float));
+        b.tmp = (float*)malloc(N * sizeof(float));
+        b.counts = (int*)malloc(2 * newsize * sizeof(int)); // вторая половина - для Gatherv кольца
+        b.displs = (int*)malloc(2 * newsize * sizeof(int));
+        float *reference = (float*)malloc(N * sizeof(float));
+        srand(time(NULL) + rank);
+        for (int i = 0; i < N; i++) b.data[i] = (float)(rand() % 100000);
 
-        // For accurate measurement, loop if N small
-        int iterations = (N < 1000) ? 10000 : 1; // Adjust
-        for (int it = 0; it < iterations; it++) {
-            MPI_Reduce(data, min_data, N, MPI_FLOAT, MPI_MIN, 0, newcomm);
+        if (overlap) {
+            MPI_Reduce(b.data, reference, N, MPI_FLOAT, MPI_MIN, 0, newcomm);
+            overlap_bench(&b, reference, N, newcomm, newrank, segs, nsegs, compute_us, poll_us,
+                          persistent, target);
+        } else if (newrank == 0) {
+            printf("Редукция MPI_MIN на %d четных процессах из %d, размеры %d..%d float, %.2f с на замер\n",
+                   newsize, size, min_n, N, target);
+            // Заголовок выровнен вручную: printf считает ширину в байтах, а кириллица - два байта на букву
+            printf(" элементов       способ  повт.     мин, мкс медиана, мкс    макс, мкс  проверка\n");
         }
 
-        if (newrank == 0) {
-            end_time = MPI_Wtime();
-            double avg_time = (end_time - start_time) / iterations;
-            printf("Среднее время редукции: %f секунд\n", avg_time);
-            // Print min_data if needed
+        for (int n = min_n; !overlap; n = (n > N / 2) ? N : 2 * n) {
+            // Эталон для проверки
+            MPI_Reduce(b.data, reference, n, MPI_FLOAT, MPI_MIN, 0, newcomm);
+
+            double med[NUM_ALGS], mn[NUM_ALGS], mx[NUM_ALGS];
+            int reps_used[NUM_ALGS], bad[NUM_ALGS];
+            for (int alg = 0; alg < NUM_ALGS; alg++) {
+                if (!algs[alg]) continue;
+
+                AlgRun run = {alg, &b, n, newcomm, newrank, newsize};
+                poison_result(b.result, n);
+                reps_used[alg] = measure(alg_fn, &run, newcomm, newrank, target, &mn[alg], &med[alg], &mx[alg]);
+
+                if (newrank == 0) {
+                    bad[alg] = 0;
+                    for (int i = 0; i < n; i++)
+                        if (b.result[i] != reference[i]) bad[alg]++;
+                }
+            }
+
+            if (newrank == 0) {
+                int best = -1;
+                for (int alg = 0; alg < NUM_ALGS; alg++)
+                    if (algs[alg] && (best < 0 || med[alg] < med[best])) best = alg;
+                for (int alg = 0; alg < NUM_ALGS; alg++) {
+                    if (!algs[alg]) continue;
+                    char check[32];
+                    if (bad[alg]) snprintf(check, sizeof(check), "%d ошибок", bad[alg]);
+                    else snprintf(check, sizeof(check), "OK");
+                    printf("%10d %12s %6d %12.1f %12.1f %12.1f %9s%s\n", n, alg_names[alg], reps_used[alg],
+                           mn[alg] * 1e6, med[alg] * 1e6, mx[alg] * 1e6, check, alg == best ? " *" : "");
+                }
+            }
+            if (n == N) break;
         }
 
-        if (newrank == 0) free(min_data);
+        free(reference);
+        free(b.data);
+        free(b.result);
+        free(b.acc);
+        free(b.tmp);
+        free(b.counts);
+        free(b.displs);
+        MPI_Comm_free(&newcomm);
     }
 
-    if (rank % 2 == 0) free(data);
-    if (newcomm != MPI_COMM_NULL) MPI_Comm_free(&newcomm);
-
     MPI_Finalize();
     return 0;
 }
@@ -1,21 +1,65 @@
+import csv
+import json
+import sys
+from collections import defaultdict
+
 import matplotlib.pyplot as plt
 
-# Ваши данные
-procs = [1, 4, 25]
-ideal = [1, 4, 25]
+# Результаты пишет сама программа (v2 --sizes=... --csv=results.csv), по файлу на запуск
+# или все запуски (P = 1, 4, 25...) в один файл:
+#   mpirun -np 1  ./v2 --sizes=100,500,2000 --reps=5 --warmup=1 --csv=results.csv
+#   mpirun -np 4  ./v2 --sizes=100,500,2000 --reps=5 --warmup=1 --csv=results.csv
+#   python3 g.py results.csv
+# Принимаются и файлы --json=FILE (по объекту JSON на строку).
+files = sys.argv[1:] or ['results.csv']
+
+
+def load(path):
+    with open(path, encoding='utf-8') as f:
+        if path.endswith('.json') or path.endswith('.jsonl'):
+            return [json.loads(line) for line in f if line.strip()]
+        return list(csv.DictReader(f))
+
 
-# Ускорение (данные из таблицы)
-s_2000 = [1.0, 4.00, 2.92]  # Большая задача
-s_500  = [1.0, 3.96, 2.05]  # Средняя
-s_100  = [1.0, 4.79, 0.49]  # Малая
+rows = [r for path in files for r in load(path)]
+
+# Время одного размера на одном числе процессов: лучшее по всем запускам одного варианта.
+# Вариант - алгоритм, тип, ядро, набор инструкций, перекрытие и потоки: разные не смешиваются.
+# В старых файлах колонок kernel/isa/overlap может не быть.
+best = defaultdict(dict)  # (algo, type, kernel, isa, overlap, threads, N) -> {P: t_min}
+for r in rows:
+    key = (r['algo'], r['type'], r.get('kernel', ''), r.get('isa', ''), int(r.get('overlap', 0)),
+           int(r['threads']), int(r['n']))
+    p, t = int(r['procs']), float(r['t_min'])
+    best[key][p] = min(t, best[key].get(p, t))
 
 plt.figure(figsize=(10, 6))
 
-# Рисуем линии
-plt.plot(procs, ideal, 'k--', label='Идеальное ускорение', alpha=0.5)
-plt.plot(procs, s_2000, 'go-', linewidth=3, label='N=2000 (Большая матрица)')
-plt.plot(procs, s_500,  'bo-', label='N=500 (Средняя матрица)')
-plt.plot(procs, s_100,  'rs-', label='N=100 (Малая матрица)')
+all_procs = set()
+markers = 'osd^v<>'
+for i, key in enumerate(sorted(best, key=lambda k: (k[:-1], -k[-1]))):
+    times = best[key]
+    if 1 not in times:
+        print(f'Пропуск {key}: нет запуска на 1 процессе для ускорения')
+        continue
+    procs = sorted(times)
+    speedup = [times[1] / times[p] for p in procs]
+    all_procs.update(procs)
+    algo, typ, kernel, isa, overlap, threads, n = key
+    parts = [algo, typ] + [x for x in (kernel, isa) if x]
+    if overlap:
+        parts.append('перекрытие')
+    if threads > 1:
+        parts.append(f'{threads} потоков')
+    label = f'N={n} (' + ', '.join(parts) + ')'
+    plt.plot(procs, speedup, marker=markers[i % len(markers)], label=label)
+
+if not all_procs:
+    sys.exit('Нет данных для графика')
+
+# Идеальное ускорение
+ideal = sorted(all_procs)
+plt.plot(ideal, ideal, 'k--', label='Идеальное ускорение', alpha=0.5)
 
 # Настройки
 plt.title('График ускорения (MPI Cannon)', fontsize=14)
@@ -23,7 +67,7 @@ plt.xlabel('Количество процессов', fontsize=12)
 plt.ylabel('Ускорение', fontsize=12)
 plt.grid(True)
 plt.legend()
-plt.xticks([1, 4, 25])
+plt.xticks(ideal)
 
 # Сохранение
 plt.savefig('graph.png')
@@ -18,8 +18,100 @@ void serial_multiply(int n, int *A, int *B, int *C) {
     }
 }
 
+// --- Блочное ядро (GEMM) ---
+// Панель A размером MC x KC держится в L2, панель B размером KC x NC - в L3,
+// микроядро MR x NR накапливает блок C в регистрах.
+#define GEMM_MC 96
+#define GEMM_KC 256
+#define GEMM_NC 2048
+#define GEMM_MR 4
+#define GEMM_NR 8
+
+#define KERNEL_NAIVE   0
+#define KERNEL_BLOCKED 1
+
+static int kernel_kind = KERNEL_BLOCKED; // Выбирается флагом --kernel=naive|blocked
+
+static int imin(int a, int b) { return a < b ? a : b; }
+
+// Упаковка куска A (mc x kc) в полосы высотой MR: внутри полосы элементы идут по столбцам.
+// Неполная последняя полоса дополняется нулями, чтобы микроядро не проверяло границы.
+static void pack_A(int mc, int kc, const int *A, int lda, int *Ap) {
+    for (int i = 0; i < mc; i += GEMM_MR) {
+        int mr = imin(GEMM_MR, mc - i);
+        for (int p = 0; p < kc; p++) {
+            for (int r = 0; r < GEMM_MR; r++) {
+                *Ap++ = (r < mr) ? A[(i + r) * lda + p] : 0;
+            }
+        }
+    }
+}
+
+// Упаковка куска B (kc x nc) в полосы шириной NR: внутри полосы элементы идут по строкам.
+static void pack_B(int kc, int nc, const int *B, int ldb, int *Bp) {
+    for (int j = 0; j < nc; j += GEMM_NR) {
+        int nr = imin(GEMM_NR, nc - j);
+        for (int p = 0; p < kc; p++) {
+            for (int c = 0; c < GEMM_NR; c++) {
+                *Bp++ = (c < nr) ? B[p * ldb + j + c] : 0;
+            }
+        }
+    }
+}
+
+// Микроядро: C[mr x nr] += Ap * Bp, где Ap - полоса MR x kc, Bp - полоса kc x NR.
+static void micro_kernel(int kc, const int *Ap, const int *Bp, int *C, int ldc, int mr, int nr) {
+    int acc[GEMM_MR][GEMM_NR] = {{0}};
+    for (int p = 0; p < kc; p++) {
+        for (int r = 0; r < GEMM_MR; r++) {
+            int a = Ap[p * GEMM_MR + r];
+            for (int c = 0; c < GEMM_NR; c++) {
+                acc[r][c] += a * Bp[p * GEMM_NR + c];
+            }
+        }
+    }
+    for (int r = 0; r < mr; r++) {
+        for (int c = 0; c < nr; c++) {
+            C[r * ldc + c] += acc[r][c];
+        }
+    }
+}
+
+// C (m x n) += A (m x k) * B (k x n), матрицы хранятся по строкам с ведущими размерностями lda/ldb/ldc
+void gemm_blocked(int m, int n, int k, const int *A, int lda, const int *B, int ldb, int *C, int ldc) {
+    int *Ap = (int*)malloc(GEMM_MC * GEMM_KC * sizeof(int));
+    int *Bp = (int*)malloc(GEMM_KC * GEMM_NC * sizeof(int));
+
+    for (int jc = 0; jc < n; jc += GEMM_NC) {
+        int nc = imin(GEMM_NC, n - jc);
+        for (int pc = 0; pc < k; pc += GEMM_KC) {
+            int kc = imin(GEMM_KC, k - pc);
+            pack_B(kc, nc, &B[pc * ldb + jc], ldb, Bp);
+
+            for (int ic = 0; ic < m; ic += GEMM_MC) {
+                int mc = imin(GEMM_MC, m - ic);
+                pack_A(mc, kc, &A[ic * lda + pc], lda, Ap);
+
+                for (int jr = 0; jr < nc; jr += GEMM_NR) {
+                    for (int ir = 0; ir < mc; ir += GEMM_MR) {
+                        micro_kernel(kc, &Ap[ir * kc], &Bp[jr * kc],
+                                     &C[(ic + ir) * ldc + jc + jr], ldc,
+                                     imin(GEMM_MR, mc - ir), imin(GEMM_NR, nc - jr));
+                    }
+                }
+            }
+        }
+    }
+
+    free(Ap); free(Bp);
+}
+
 // Локальное умножение блоков
 void matrix_multiply_add(int n, int *A, int *B, int *C) {
+    if (kernel_kind == KERNEL_BLOCKED) {
+        gemm_blocked(n, n, n, A, n, B, n, C, n);
+        return;
+    }
     for (int i = 0; i < n; i++) {
         for (int k = 0; k < n; k++) {
             int temp = A[i * n + k];
@@ -30,6 +122,18 @@ void matrix_multiply_add(int n, int *A, int *B, int *C) {
     }
 }
 
+// Разбор флага --kernel=naive|blocked (одинаково на всех процессах)
+int parse_kernel_flag(int argc, char **argv) {
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--kernel=", 9) != 0) continue;
+        const char *name = argv[i] + 9;
+        if (strcmp(name, "naive") == 0) kernel_kind = KERNEL_NAIVE;
+        else if (strcmp(name, "blocked") == 0) kernel_kind = KERNEL_BLOCKED;
+        else return -1;
+    }
+    return 0;
+}
+
 // Строки -> Блоки
 void convert_to_blocks(int *input, int *output, int N, int grid_dim) {
     int block_size = N / grid_dim;
@@ -71,6 +175,12 @@ int main(int argc, char **argv) {
     MPI_Comm_rank(MPI_COMM_WORLD, &rank);
     MPI_Comm_size(MPI_COMM_WORLD, &size);
 
+    if (parse_kernel_flag(argc, argv) != 0) {
+        if (rank == 0) fprintf(stderr, "Ошибка: неизвестное ядро, ожидается --kernel=naive или --kernel=blocked\n");
+        MPI_Finalize();
+        return 1;
+    }
+
     int dims[2] = {0, 0};
     MPI_Dims_create(size, 2, dims);
     if (dims[0] != dims[1]) {
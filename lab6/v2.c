@@ -1,35 +1,515 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
+#include <float.h>
+#include <string.h>
 #include <time.h>
 #include <mpi.h>
 
-// Последовательное умножение (для проверки)
-void serial_multiply(int n, int *A, int *B, int *C) {
-    for (int i = 0; i < n * n; i++) C[i] = 0;
-    for (int i = 0; i < n; i++) {
-        for (int k = 0; k < n; k++) {
-            int temp = A[i * n + k];
-            for (int j = 0; j < n; j++) {
-                C[i * n + j] += temp * B[k * n + j];
-            }
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_SIMD 1
+#else
+#define HAVE_X86_SIMD 0
+#endif
+
+// Потоки включаются при сборке с OpenMP: mpicc -O3 -fopenmp v2.c -o v2 -lm
+#ifdef _OPENMP
+#include <omp.h>
+#define OMP_PRAGMA(x) _Pragma(#x)
+#else
+#define OMP_PRAGMA(x)
+#endif
+
+static int imin(int a, int b) { return a < b ? a : b; }
+
+// --- Блочное ядро (GEMM) ---
+// Панель A размером MC x KC держится в L2, панель B размером KC x NC - в L3,
+// микроядро MR x NR накапливает блок C в регистрах.
+// MC и NC кратны MR и NR всех микроядер ниже.
+#define GEMM_MC 96
+#define GEMM_KC 256
+#define GEMM_NC 2048
+#define GEMM_JW 256 // ширина куска B, который поток обрабатывает с одной панелью A
+#define GEMM_MR_MAX 8
+#define GEMM_NR_MAX 32
+
+#define KERNEL_NAIVE   0
+#define KERNEL_BLOCKED 1
+
+static int kernel_kind = KERNEL_BLOCKED; // Выбирается флагом --kernel=naive|blocked
+
+// Набор инструкций микроядра. Выбирается по CPUID при запуске (--isa=... переопределяет)
+#define ISA_SCALAR 0
+#define ISA_AVX2   1
+#define ISA_AVX512 2
+#define ISA_COUNT  3
+
+static const char *isa_names[ISA_COUNT] = {"scalar", "avx2", "avx512"};
+
+// Поддерживает ли процессор данный набор инструкций
+static int isa_supported(int isa) {
+#if HAVE_X86_SIMD
+    __builtin_cpu_init();
+    if (isa == ISA_AVX2) return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    if (isa == ISA_AVX512) return __builtin_cpu_supports("avx512f");
+#endif
+    return isa == ISA_SCALAR;
+}
+
+/*
+ * Обобщенная часть GEMM: A и B типа T, C и накопление - типа ACC (суффикс S в именах):
+ * - ref_gemm_S / serial_multiply_S: наивный эталон;
+ * - pack_A_S / pack_B_S: упаковка панелей под микроядро mr x nr;
+ * - micro_S_scalar: переносимое микроядро 4 x 8;
+ * - gemm_blocked_S: блочный обход, микроядро берется из gemm_kernel_S.
+ * - local_gemm_S / naive_gemm_S: вызов через void * для таблицы типов элементов.
+ * Микроядро всегда считает полный тайл MR x NR: C[MR x NR] += Ap * Bp.
+ */
+#define DEFINE_GEMM(T, ACC, S)                                                         \
+typedef void (*micro_fn_##S)(int kc, const T *Ap, const T *Bp, ACC *C, int ldc);       \
+                                                                                       \
+typedef struct {                                                                       \
+    int isa;                                                                           \
+    int mr, nr;                                                                        \
+    micro_fn_##S micro;                                                                \
+} gemm_desc_##S;                                                                       \
+                                                                                       \
+void ref_gemm_##S(int m, int n, int k, const T *A, int lda, const T *B, int ldb,       \
+                  ACC *C, int ldc) {                                                   \
+    OMP_PRAGMA(omp parallel for schedule(static))                                      \
+    for (int i = 0; i < m; i++) {                                                      \
+        for (int p = 0; p < k; p++) {                                                  \
+            ACC temp = A[i * lda + p];                                                 \
+            for (int j = 0; j < n; j++) {                                              \
+                C[i * ldc + j] += temp * B[p * ldb + j];                               \
+            }                                                                          \
+        }                                                                              \
+    }                                                                                  \
+}                                                                                      \
+                                                                                       \
+/* Последовательное умножение (для проверки) */                                        \
+void serial_multiply_##S(int n, const T *A, const T *B, ACC *C) {                      \
+    for (int i = 0; i < n * n; i++) C[i] = 0;                                          \
+    ref_gemm_##S(n, n, n, A, n, B, n, C, n);                                           \
+}                                                                                      \
+                                                                                       \
+/* Упаковка A (mc x kc) в полосы высотой mr по столбцам, хвост дополняется нулями */   \
+static void pack_A_##S(int mc, int kc, const T *A, int lda, T *Ap, int mr) {           \
+    for (int i = 0; i < mc; i += mr) {                                                 \
+        int rows = imin(mr, mc - i);                                                   \
+        for (int p = 0; p < kc; p++) {                                                 \
+            for (int r = 0; r < mr; r++) {                                             \
+                *Ap++ = (r < rows) ? A[(i + r) * lda + p] : (T)0;                      \
+            }                                                                          \
+        }                                                                              \
+    }                                                                                  \
+}                                                                                      \
+                                                                                       \
+/* Упаковка B (kc x nc) в полосы шириной nr по строкам */                              \
+static void pack_B_##S(int kc, int nc, const T *B, int ldb, T *Bp, int nr) {           \
+    for (int j = 0; j < nc; j += nr) {                                                 \
+        int cols = imin(nr, nc - j);                                                   \
+        for (int p = 0; p < kc; p++) {                                                 \
+            for (int c = 0; c < nr; c++) {                                             \
+                *Bp++ = (c < cols) ? B[p * ldb + j + c] : (T)0;                        \
+            }                                                                          \
+        }                                                                              \
+    }                                                                                  \
+}                                                                                      \
+                                                                                       \
+static void micro_##S##_scalar(int kc, const T *Ap, const T *Bp, ACC *C, int ldc) {    \
+    ACC acc[4][8] = {{0}};                                                             \
+    for (int p = 0; p < kc; p++) {                                                     \
+        for (int r = 0; r < 4; r++) {                                                  \
+            ACC a = Ap[p * 4 + r];                                                     \
+            for (int c = 0; c < 8; c++) {                                              \
+                acc[r][c] += a * Bp[p * 8 + c];                                        \
+            }                                                                          \
+        }                                                                              \
+    }                                                                                  \
+    for (int r = 0; r < 4; r++) {                                                      \
+        for (int c = 0; c < 8; c++) {                                                  \
+            C[r * ldc + c] += acc[r][c];                                               \
+        }                                                                              \
+    }                                                                                  \
+}                                                                                      \
+                                                                                       \
+static gemm_desc_##S gemm_kernel_##S = {ISA_SCALAR, 4, 8, micro_##S##_scalar};         \
+                                                                                       \
+/* C (m x n) += A (m x k) * B (k x n), хранение по строкам с ведущими размерностями.   \
+   Панель B пакуется всеми потоками вместе, дальше потоки разбирают куски              \
+   (панель A) x (GEMM_JW столбцов B), у каждого потока своя упакованная панель A. */   \
+void gemm_blocked_##S(int m, int n, int k, const T *A, int lda, const T *B, int ldb,   \
+                      ACC *C, int ldc) {                                               \
+    const gemm_desc_##S kern = gemm_kernel_##S;                                        \
+    T *Bp = (T*)malloc(GEMM_KC * GEMM_NC * sizeof(T));                                 \
+                                                                                       \
+    OMP_PRAGMA(omp parallel)                                                           \
+    {                                                                                  \
+        T *Ap = (T*)malloc(GEMM_MC * GEMM_KC * sizeof(T));                             \
+        ACC tile[GEMM_MR_MAX * GEMM_NR_MAX]; /* для неполных тайлов на краях */        \
+                                                                                       \
+        for (int jc = 0; jc < n; jc += GEMM_NC) {                                      \
+            int nc = imin(GEMM_NC, n - jc);                                            \
+            for (int pc = 0; pc < k; pc += GEMM_KC) {                                  \
+                int kc = imin(GEMM_KC, k - pc);                                        \
+                                                                                       \
+                OMP_PRAGMA(omp for schedule(static))                                   \
+                for (int j = 0; j < nc; j += kern.nr) {                                \
+                    pack_B_##S(kc, imin(kern.nr, nc - j), &B[pc * ldb + jc + j], ldb,  \
+                               &Bp[j * kc], kern.nr);                                  \
+                }                                                                      \
+                                                                                       \
+                OMP_PRAGMA(omp for collapse(2) schedule(dynamic))                      \
+                for (int ic = 0; ic < m; ic += GEMM_MC) {                              \
+                    for (int jw = 0; jw < nc; jw += GEMM_JW) {                         \
+                        int mc = imin(GEMM_MC, m - ic);                                \
+                        int jend = imin(jw + GEMM_JW, nc);                             \
+                        pack_A_##S(mc, kc, &A[ic * lda + pc], lda, Ap, kern.mr);       \
+                                                                                       \
+                        for (int jr = jw; jr < jend; jr += kern.nr) {                  \
+                            int nr = imin(kern.nr, nc - jr);                           \
+                            for (int ir = 0; ir < mc; ir += kern.mr) {                 \
+                                int mr = imin(kern.mr, mc - ir);                       \
+                                ACC *Cij = &C[(ic + ir) * ldc + jc + jr];              \
+                                if (mr == kern.mr && nr == kern.nr) {                  \
+                                    kern.micro(kc, &Ap[ir * kc], &Bp[jr * kc], Cij, ldc); \
+                                    continue;                                          \
+                                }                                                      \
+                                memset(tile, 0, sizeof(tile));                         \
+                                kern.micro(kc, &Ap[ir * kc], &Bp[jr * kc], tile, kern.nr); \
+                                for (int r = 0; r < mr; r++) {                         \
+                                    for (int c = 0; c < nr; c++) {                     \
+                                        Cij[r * ldc + c] += tile[r * kern.nr + c];     \
+                                    }                                                  \
+                                }                                                      \
+                            }                                                          \
+                        }                                                              \
+                    }                                                                  \
+                }                                                                      \
+            }                                                                          \
+        }                                                                              \
+                                                                                       \
+        free(Ap);                                                                      \
+    }                                                                                  \
+                                                                                       \
+    free(Bp);                                                                          \
+}                                                                                      \
+                                                                                       \
+static void local_gemm_##S(int m, int n, int k, const void *A, int lda, const void *B, \
+                           int ldb, void *C, int ldc) {                                \
+    if (kernel_kind == KERNEL_BLOCKED)                                                 \
+        gemm_blocked_##S(m, n, k, (const T*)A, lda, (const T*)B, ldb, (ACC*)C, ldc);   \
+    else ref_gemm_##S(m, n, k, (const T*)A, lda, (const T*)B, ldb, (ACC*)C, ldc);      \
+}                                                                                      \
+                                                                                       \
+static void naive_gemm_##S(int m, int n, int k, const void *A, int lda,                \
+                           const void *B, int ldb, void *C, int ldc) {                 \
+    ref_gemm_##S(m, n, k, (const T*)A, lda, (const T*)B, ldb, (ACC*)C, ldc);           \
+}
+
+// int32 накапливается в int64: сумма N произведений не переполняется при реальных N
+DEFINE_GEMM(int, long long, i32)
+DEFINE_GEMM(float, float, f32)
+DEFINE_GEMM(double, double, f64)
+
+#if HAVE_X86_SIMD
+// --- Векторные микроядра ---
+// AVX2: тайл 6 x (2 регистра), AVX-512: тайл 8 x (2 регистра).
+// Аккумуляторы C живут в регистрах весь цикл по kc, A подается broadcast-ом.
+
+// int32 -> int64: B расширяется при загрузке (cvtepi32_epi64), _mm256_mul_epi32 дает
+// полное 64-битное произведение младших 32 бит каждой полосы. Тайл 6 x 8 (2 регистра по 4).
+__attribute__((target("avx2")))
+static void micro_i32_avx2(int kc, const int *Ap, const int *Bp, long long *C, int ldc) {
+    __m256i c[6][2];
+    for (int r = 0; r < 6; r++) {
+        c[r][0] = _mm256_loadu_si256((const __m256i*)&C[r * ldc]);
+        c[r][1] = _mm256_loadu_si256((const __m256i*)&C[r * ldc + 4]);
+    }
+    for (int p = 0; p < kc; p++) {
+        __m256i b0 = _mm256_cvtepi32_epi64(_mm_loadu_si128((const __m128i*)&Bp[p * 8]));
+        __m256i b1 = _mm256_cvtepi32_epi64(_mm_loadu_si128((const __m128i*)&Bp[p * 8 + 4]));
+        for (int r = 0; r < 6; r++) {
+            __m256i a = _mm256_set1_epi64x(Ap[p * 6 + r]);
+            c[r][0] = _mm256_add_epi64(c[r][0], _mm256_mul_epi32(a, b0));
+            c[r][1] = _mm256_add_epi64(c[r][1], _mm256_mul_epi32(a, b1));
+        }
+    }
+    for (int r = 0; r < 6; r++) {
+        _mm256_storeu_si256((__m256i*)&C[r * ldc], c[r][0]);
+        _mm256_storeu_si256((__m256i*)&C[r * ldc + 4], c[r][1]);
+    }
+}
+
+__attribute__((target("avx2,fma")))
+static void micro_f32_avx2(int kc, const float *Ap, const float *Bp, float *C, int ldc) {
+    __m256 c[6][2];
+    for (int r = 0; r < 6; r++) {
+        c[r][0] = _mm256_loadu_ps(&C[r * ldc]);
+        c[r][1] = _mm256_loadu_ps(&C[r * ldc + 8]);
+    }
+    for (int p = 0; p < kc; p++) {
+        __m256 b0 = _mm256_loadu_ps(&Bp[p * 16]);
+        __m256 b1 = _mm256_loadu_ps(&Bp[p * 16 + 8]);
+        for (int r = 0; r < 6; r++) {
+            __m256 a = _mm256_broadcast_ss(&Ap[p * 6 + r]);
+            c[r][0] = _mm256_fmadd_ps(a, b0, c[r][0]);
+            c[r][1] = _mm256_fmadd_ps(a, b1, c[r][1]);
+        }
+    }
+    for (int r = 0; r < 6; r++) {
+        _mm256_storeu_ps(&C[r * ldc], c[r][0]);
+        _mm256_storeu_ps(&C[r * ldc + 8], c[r][1]);
+    }
+}
+
+__attribute__((target("avx2,fma")))
+static void micro_f64_avx2(int kc, const double *Ap, const double *Bp, double *C, int ldc) {
+    __m256d c[6][2];
+    for (int r = 0; r < 6; r++) {
+        c[r][0] = _mm256_loadu_pd(&C[r * ldc]);
+        c[r][1] = _mm256_loadu_pd(&C[r * ldc + 4]);
+    }
+    for (int p = 0; p < kc; p++) {
+        __m256d b0 = _mm256_loadu_pd(&Bp[p * 8]);
+        __m256d b1 = _mm256_loadu_pd(&Bp[p * 8 + 4]);
+        for (int r = 0; r < 6; r++) {
+            __m256d a = _mm256_broadcast_sd(&Ap[p * 6 + r]);
+            c[r][0] = _mm256_fmadd_pd(a, b0, c[r][0]);
+            c[r][1] = _mm256_fmadd_pd(a, b1, c[r][1]);
+        }
+    }
+    for (int r = 0; r < 6; r++) {
+        _mm256_storeu_pd(&C[r * ldc], c[r][0]);
+        _mm256_storeu_pd(&C[r * ldc + 4], c[r][1]);
+    }
+}
+
+// int32 -> int64 как в AVX2-версии, тайл 8 x 16 (2 регистра по 8)
+__attribute__((target("avx512f")))
+static void micro_i32_avx512(int kc, const int *Ap, const int *Bp, long long *C, int ldc) {
+    __m512i c[8][2];
+    for (int r = 0; r < 8; r++) {
+        c[r][0] = _mm512_loadu_si512(&C[r * ldc]);
+        c[r][1] = _mm512_loadu_si512(&C[r * ldc + 8]);
+    }
+    for (int p = 0; p < kc; p++) {
+        __m512i b0 = _mm512_cvtepi32_epi64(_mm256_loadu_si256((const __m256i*)&Bp[p * 16]));
+        __m512i b1 = _mm512_cvtepi32_epi64(_mm256_loadu_si256((const __m256i*)&Bp[p * 16 + 8]));
+        for (int r = 0; r < 8; r++) {
+            __m512i a = _mm512_set1_epi64(Ap[p * 8 + r]);
+            c[r][0] = _mm512_add_epi64(c[r][0], _mm512_mul_epi32(a, b0));
+            c[r][1] = _mm512_add_epi64(c[r][1], _mm512_mul_epi32(a, b1));
+        }
+    }
+    for (int r = 0; r < 8; r++) {
+        _mm512_storeu_si512(&C[r * ldc], c[r][0]);
+        _mm512_storeu_si512(&C[r * ldc + 8], c[r][1]);
+    }
+}
+
+__attribute__((target("avx512f")))
+static void micro_f32_avx512(int kc, const float *Ap, const float *Bp, float *C, int ldc) {
+    __m512 c[8][2];
+    for (int r = 0; r < 8; r++) {
+        c[r][0] = _mm512_loadu_ps(&C[r * ldc]);
+        c[r][1] = _mm512_loadu_ps(&C[r * ldc + 16]);
+    }
+    for (int p = 0; p < kc; p++) {
+        __m512 b0 = _mm512_loadu_ps(&Bp[p * 32]);
+        __m512 b1 = _mm512_loadu_ps(&Bp[p * 32 + 16]);
+        for (int r = 0; r < 8; r++) {
+            __m512 a = _mm512_set1_ps(Ap[p * 8 + r]);
+            c[r][0] = _mm512_fmadd_ps(a, b0, c[r][0]);
+            c[r][1] = _mm512_fmadd_ps(a, b1, c[r][1]);
+        }
+    }
+    for (int r = 0; r < 8; r++) {
+        _mm512_storeu_ps(&C[r * ldc], c[r][0]);
+        _mm512_storeu_ps(&C[r * ldc + 16], c[r][1]);
+    }
+}
+
+__attribute__((target("avx512f")))
+static void micro_f64_avx512(int kc, const double *Ap, const double *Bp, double *C, int ldc) {
+    __m512d c[8][2];
+    for (int r = 0; r < 8; r++) {
+        c[r][0] = _mm512_loadu_pd(&C[r * ldc]);
+        c[r][1] = _mm512_loadu_pd(&C[r * ldc + 8]);
+    }
+    for (int p = 0; p < kc; p++) {
+        __m512d b0 = _mm512_loadu_pd(&Bp[p * 16]);
+        __m512d b1 = _mm512_loadu_pd(&Bp[p * 16 + 8]);
+        for (int r = 0; r < 8; r++) {
+            __m512d a = _mm512_set1_pd(Ap[p * 8 + r]);
+            c[r][0] = _mm512_fmadd_pd(a, b0, c[r][0]);
+            c[r][1] = _mm512_fmadd_pd(a, b1, c[r][1]);
         }
     }
+    for (int r = 0; r < 8; r++) {
+        _mm512_storeu_pd(&C[r * ldc], c[r][0]);
+        _mm512_storeu_pd(&C[r * ldc + 8], c[r][1]);
+    }
+}
+#endif
+
+// Устанавливает микроядра всех типов для заданного набора инструкций
+void select_isa(int isa) {
+    gemm_kernel_i32 = (gemm_desc_i32){ISA_SCALAR, 4, 8, micro_i32_scalar};
+    gemm_kernel_f32 = (gemm_desc_f32){ISA_SCALAR, 4, 8, micro_f32_scalar};
+    gemm_kernel_f64 = (gemm_desc_f64){ISA_SCALAR, 4, 8, micro_f64_scalar};
+#if HAVE_X86_SIMD
+    if (isa == ISA_AVX2) {
+        gemm_kernel_i32 = (gemm_desc_i32){ISA_AVX2, 6, 8, micro_i32_avx2};
+        gemm_kernel_f32 = (gemm_desc_f32){ISA_AVX2, 6, 16, micro_f32_avx2};
+        gemm_kernel_f64 = (gemm_desc_f64){ISA_AVX2, 6, 8, micro_f64_avx2};
+    } else if (isa == ISA_AVX512) {
+        gemm_kernel_i32 = (gemm_desc_i32){ISA_AVX512, 8, 16, micro_i32_avx512};
+        gemm_kernel_f32 = (gemm_desc_f32){ISA_AVX512, 8, 32, micro_f32_avx512};
+        gemm_kernel_f64 = (gemm_desc_f64){ISA_AVX512, 8, 16, micro_f64_avx512};
+    }
+#endif
+}
+
+// Лучший набор инструкций, доступный на этом процессоре
+int detect_isa(void) {
+    for (int isa = ISA_COUNT - 1; isa > ISA_SCALAR; isa--) {
+        if (isa_supported(isa)) return isa;
+    }
+    return ISA_SCALAR;
+}
+
+// --- Тип элементов (--type=int32|float|double) ---
+// A и B хранятся в типе элемента, C - в типе накопления (для int32 это int64).
+// Ядра всех типов собраны в одном бинарнике, тип выбирается при запуске.
+#define ELEM_I32 0
+#define ELEM_F32 1
+#define ELEM_F64 2
+#define ELEM_COUNT 3
+
+static const char *elem_names[ELEM_COUNT] = {"int32", "float", "double"};
+
+typedef void (*gemm_fn)(int m, int n, int k, const void *A, int lda, const void *B, int ldb,
+                        void *C, int ldc);
+
+typedef struct {
+    int id;                         // ELEM_*
+    const char *name;
+    size_t esize, csize;            // байт на элемент A/B и на элемент C
+    MPI_Datatype mpi_elem, mpi_acc; // соответствующие типы MPI
+    double eps;                     // точность накопления (0 - целые, считаются точно)
+    gemm_fn gemm;                   // C += A * B ядром, выбранным --kernel
+    gemm_fn gemm_ref;               // эталон --verify=full: наивный цикл (OpenMP), без упаковки
+                                    // и микроядер, чтобы их ошибка не повторилась в эталоне
+} elem_type;
+
+// Заполнение описателя типа по имени; -1, если тип неизвестен
+int elem_type_init(const char *name, elem_type *t) {
+    int id = -1;
+    for (int i = 0; i < ELEM_COUNT; i++) {
+        if (strcmp(name, elem_names[i]) == 0) id = i;
+    }
+    if (id == ELEM_I32) {
+        *t = (elem_type){id, elem_names[id], sizeof(int), sizeof(long long), MPI_INT, MPI_LONG_LONG,
+                         0.0, local_gemm_i32, naive_gemm_i32};
+    } else if (id == ELEM_F32) {
+        *t = (elem_type){id, elem_names[id], sizeof(float), sizeof(float), MPI_FLOAT, MPI_FLOAT,
+                         FLT_EPSILON, local_gemm_f32, naive_gemm_f32};
+    } else if (id == ELEM_F64) {
+        *t = (elem_type){id, elem_names[id], sizeof(double), sizeof(double), MPI_DOUBLE, MPI_DOUBLE,
+                         DBL_EPSILON, local_gemm_f64, naive_gemm_f64};
+    }
+    return id < 0 ? -1 : 0;
 }
 
-// Локальное умножение блоков (C += A * B)
-void matrix_multiply_add(int n, int *A, int *B, int *C) {
-    for (int i = 0; i < n; i++) {
-        for (int k = 0; k < n; k++) {
-            int temp = A[i * n + k];
-            for (int j = 0; j < n; j++) {
-                C[i * n + j] += temp * B[k * n + j];
+// Разбор флагов --kernel=naive|blocked и --isa=scalar|avx2|avx512 (одинаково на всех процессах).
+// Без --isa набор инструкций определяется по CPUID.
+int parse_kernel_flags(int argc, char **argv) {
+    int isa = detect_isa();
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--kernel=", 9) == 0) {
+            const char *name = argv[i] + 9;
+            if (strcmp(name, "naive") == 0) kernel_kind = KERNEL_NAIVE;
+            else if (strcmp(name, "blocked") == 0) kernel_kind = KERNEL_BLOCKED;
+            else return -1;
+        } else if (strncmp(argv[i], "--isa=", 6) == 0) {
+            int found = -1;
+            for (int j = 0; j < ISA_COUNT; j++) {
+                if (strcmp(argv[i] + 6, isa_names[j]) == 0) found = j;
             }
+            if (found < 0 || !isa_supported(found)) return -1;
+            isa = found;
+        }
+    }
+    select_isa(isa);
+    return 0;
+}
+
+/*
+ * Самопроверка (--selftest): каждое доступное микроядро каждого типа
+ * сравнивается с наивным эталоном на квадратных и "рваных" размерах.
+ * Целые должны совпасть побитно (значения до 10^6: произведения не влезают в int32,
+ * так проверяется расширение до int64), float/double - с относительной точностью.
+ */
+#define DEFINE_SELFTEST(T, ACC, S, TOL)                                                \
+static int selftest_##S(int m, int n, int k) {                                         \
+    T *A = (T*)malloc((size_t)m * k * sizeof(T));                                      \
+    T *B = (T*)malloc((size_t)k * n * sizeof(T));                                      \
+    ACC *C = (ACC*)calloc((size_t)m * n, sizeof(ACC));                                 \
+    ACC *R = (ACC*)calloc((size_t)m * n, sizeof(ACC));                                 \
+    for (int i = 0; i < m * k; i++)                                                    \
+        A[i] = (T)((TOL) ? (rand() % 21 - 10) / 7.0 : (rand() % 2001 - 1000) * 1000);  \
+    for (int i = 0; i < k * n; i++)                                                    \
+        B[i] = (T)((TOL) ? (rand() % 21 - 10) / 3.0 : (rand() % 2001 - 1000) * 1000);  \
+    if (m == n && n == k) serial_multiply_##S(n, A, B, R);                             \
+    else ref_gemm_##S(m, n, k, A, k, B, n, R, n);                                      \
+    gemm_blocked_##S(m, n, k, A, k, B, n, C, n);                                       \
+    int errors = 0;                                                                    \
+    for (int i = 0; i < m * n; i++) {                                                  \
+        double diff = fabs((double)C[i] - (double)R[i]);                               \
+        if ((TOL) == 0 ? C[i] != R[i] : diff > (TOL) * k * (1.0 + fabs((double)R[i]))) \
+            errors++;                                                                  \
+    }                                                                                  \
+    free(A); free(B); free(C); free(R);                                                \
+    return errors;                                                                     \
+}
+
+DEFINE_SELFTEST(int, long long, i32, 0.0)
+DEFINE_SELFTEST(float, float, f32, 1e-6)
+DEFINE_SELFTEST(double, double, f64, 1e-14)
+
+int run_selftest(void) {
+    static const int shapes[][3] = {
+        {1, 1, 1}, {7, 7, 7}, {64, 64, 64}, {100, 100, 100}, {257, 257, 257},
+        {37, 29, 301}, {5, 130, 3}, {97, 2051, 19},
+    };
+    int nshapes = (int)(sizeof(shapes) / sizeof(shapes[0]));
+    int failed = 0;
+    srand(12345);
+
+    for (int isa = 0; isa < ISA_COUNT; isa++) {
+        if (!isa_supported(isa)) {
+            printf("%-7s: не поддерживается процессором, пропуск\n", isa_names[isa]);
+            continue;
+        }
+        select_isa(isa);
+        for (int s = 0; s < nshapes; s++) {
+            int m = shapes[s][0], n = shapes[s][1], k = shapes[s][2];
+            int e_i32 = selftest_i32(m, n, k);
+            int e_f32 = selftest_f32(m, n, k);
+            int e_f64 = selftest_f64(m, n, k);
+            printf("%-7s %4dx%4dx%4d: int32 %s, float %s, double %s\n", isa_names[isa], m, n, k,
+                   e_i32 ? "FAIL" : "ok", e_f32 ? "FAIL" : "ok", e_f64 ? "FAIL" : "ok");
+            failed += e_i32 + e_f32 + e_f64;
         }
     }
+    printf(failed ? ">> САМОПРОВЕРКА: найдены ошибки!\n" : ">> Все микроядра совпали с эталоном.\n");
+    return failed ? 1 : 0;
 }
 
-// Строки -> Блоки
+// Строки -> Блоки (промежуточная копия; сейчас только для сравнения в --bench-redist)
 void convert_to_blocks(int *input, int *output, int N, int grid_dim) {
     int block_size = N / grid_dim;
     int idx = 0;
@@ -63,88 +543,623 @@ void convert_from_blocks(int *input, int *output, int N, int grid_dim) {
     }
 }
 
-int main(int argc, char **argv) {
-    MPI_Init(&argc, &argv);
+// Время фаз основного цикла (Кэннон или SUMMA) на этом процессе (сек.)
+typedef struct {
+    double compute;   // локальные умножения
+    double comm_wait; // простой на обмене (не скрытая часть сдвигов)
+    double comm_est;  // оценка полного времени сдвигов без перекрытия (только --overlap)
+} phase_stats;
+
+// Основной цикл: sqrt_p раз умножаем блоки и сдвигаем A влево, B вверх (блокирующие сдвиги)
+void cannon_loop_blocking(MPI_Comm grid_comm, const elem_type *et, int sqrt_p, int block_n,
+                          void *loc_A, void *loc_B, void *loc_C, phase_stats *st) {
+    int block_size = block_n * block_n;
+    int left, right, up, down;
+    // Соседи для A (влево/вправо) - измерение 1
+    MPI_Cart_shift(grid_comm, 1, -1, &right, &left);
+    // Соседи для B (вверх/вниз) - измерение 0
+    MPI_Cart_shift(grid_comm, 0, -1, &down, &up);
+
+    for (int k = 0; k < sqrt_p; k++) {
+        // Умножаем
+        double t0 = MPI_Wtime();
+        et->gemm(block_n, block_n, block_n, loc_A, block_n, loc_B, block_n, loc_C, block_n);
+        double t1 = MPI_Wtime();
+
+        // Сдвигаем A влево, B вверх
+        MPI_Sendrecv_replace(loc_A, block_size, et->mpi_elem, left, 1, right, 1, grid_comm, MPI_STATUS_IGNORE);
+        MPI_Sendrecv_replace(loc_B, block_size, et->mpi_elem, up, 2, down, 2, grid_comm, MPI_STATUS_IGNORE);
+
+        st->compute += t1 - t0;
+        st->comm_wait += MPI_Wtime() - t1;
+    }
+}
+
+/*
+ * Оценка полного времени сдвигов Кэннона без перекрытия (для отчета --overlap): один шаг
+ * блокирующих сдвигов A и B туда и обратно на пустых блоках, пополам и на sqrt_p - 1 шагов.
+ * Вызывается один раз на конфигурацию, вне замеряемого времени run_cannon.
+ */
+double cannon_shift_estimate(MPI_Comm grid_comm, const elem_type *et, int sqrt_p, int block_n) {
+    int block_size = block_n * block_n;
+    int left, right, up, down;
+    MPI_Cart_shift(grid_comm, 1, -1, &right, &left);
+    MPI_Cart_shift(grid_comm, 0, -1, &down, &up);
+
+    MPI_Datatype type = et->mpi_elem;
+    void *A = calloc(block_size, et->esize);
+    void *B = calloc(block_size, et->esize);
+
+    MPI_Barrier(grid_comm);
+    double tc = MPI_Wtime();
+    MPI_Sendrecv_replace(A, block_size, type, left, 3, right, 3, grid_comm, MPI_STATUS_IGNORE);
+    MPI_Sendrecv_replace(B, block_size, type, up, 4, down, 4, grid_comm, MPI_STATUS_IGNORE);
+    MPI_Sendrecv_replace(A, block_size, type, right, 5, left, 5, grid_comm, MPI_STATUS_IGNORE);
+    MPI_Sendrecv_replace(B, block_size, type, down, 6, up, 6, grid_comm, MPI_STATUS_IGNORE);
+    double est = (MPI_Wtime() - tc) / 2.0 * (sqrt_p - 1);
+
+    free(A); free(B);
+    return est;
+}
+
+/*
+ * Основной цикл с перекрытием (--overlap): двойная буферизация.
+ * Сдвиг следующих блоков запускается через MPI_Isend/MPI_Irecv во второй комплект буферов,
+ * пока считается умножение текущих; после умножения ждем обмен и меняем буферы местами.
+ * На последнем шаге сдвиг не нужен - блоки A и B больше не используются.
+ * Указатели *pA и *pB могут поменяться (в конце там лежат актуальные буферы).
+ */
+void cannon_loop_overlap(MPI_Comm grid_comm, const elem_type *et, int sqrt_p, int block_n,
+                         void **pA, void **pB, void *loc_C, phase_stats *st) {
+    int block_size = block_n * block_n;
+    int left, right, up, down;
+    MPI_Cart_shift(grid_comm, 1, -1, &right, &left);
+    MPI_Cart_shift(grid_comm, 0, -1, &down, &up);
+
+    MPI_Datatype type = et->mpi_elem;
+    void *cur_A = *pA, *cur_B = *pB;
+    void *nxt_A = malloc(block_size * et->esize);
+    void *nxt_B = malloc(block_size * et->esize);
+
+    for (int k = 0; k < sqrt_p; k++) {
+        int shift = (k < sqrt_p - 1);
+        MPI_Request reqs[4];
+
+        double t0 = MPI_Wtime();
+        if (shift) {
+            MPI_Irecv(nxt_A, block_size, type, right, 1, grid_comm, &reqs[0]);
+            MPI_Irecv(nxt_B, block_size, type, down, 2, grid_comm, &reqs[1]);
+            MPI_Isend(cur_A, block_size, type, left, 1, grid_comm, &reqs[2]);
+            MPI_Isend(cur_B, block_size, type, up, 2, grid_comm, &reqs[3]);
+        }
+        double t1 = MPI_Wtime();
+
+        et->gemm(block_n, block_n, block_n, cur_A, block_n, cur_B, block_n, loc_C, block_n);
+        double t2 = MPI_Wtime();
+
+        if (shift) {
+            MPI_Waitall(4, reqs, MPI_STATUSES_IGNORE);
+            void *tmp = cur_A; cur_A = nxt_A; nxt_A = tmp;
+            tmp = cur_B; cur_B = nxt_B; nxt_B = tmp;
+        }
+
+        st->compute += t2 - t1;
+        st->comm_wait += (t1 - t0) + (MPI_Wtime() - t2);
+    }
+
+    free(nxt_A); free(nxt_B);
+    *pA = cur_A; *pB = cur_B;
+}
+
+// --- Входные матрицы ---
+#define INPUT_GEN  0 // каждый процесс сам генерирует свой блок
+#define INPUT_FILE 1 // каждый процесс читает свой блок из файла через MPI-IO
+#define INPUT_ROOT 2 // rank 0 строит матрицы целиком и раздает блоки (старый путь)
+
+typedef struct {
+    int kind;
+    unsigned long long seed;
+    const char *path[2]; // файлы A и B для INPUT_FILE: N x N по строкам в типе --type
+} input_spec;
+
+// Перемешивание splitmix64: из номера элемента и зерна - псевдослучайное 64-битное число
+static unsigned long long mix64(unsigned long long seed, unsigned long long idx) {
+    unsigned long long x = seed + 0x9E3779B97F4A7C15ULL * (idx + 1);
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+// Детерминированный генератор: элемент (i, j) матрицы which (0 - A, 1 - B) зависит
+// только от seed и координат, поэтому любой процесс может построить любой блок сам.
+static unsigned long long gen_bits(const input_spec *in, int which, int N, int i, int j) {
+    unsigned long long idx = (unsigned long long)which * N * N + (unsigned long long)i * N + j;
+    return mix64(in->seed, idx);
+}
+
+// Подмассив (row0, col0, rows x cols) матрицы N x N как вид файла; пустой блок - пустой вид
+static MPI_Datatype file_view(MPI_Datatype etype, int N, int row0, int rows, int col0, int cols) {
+    MPI_Datatype t;
+    if (rows == 0 || cols == 0) {
+        MPI_Type_contiguous(0, etype, &t);
+    } else {
+        int sizes[2] = {N, N}, subsizes[2] = {rows, cols}, starts[2] = {row0, col0};
+        MPI_Type_create_subarray(2, sizes, subsizes, starts, MPI_ORDER_C, etype, &t);
+    }
+    MPI_Type_commit(&t);
+    return t;
+}
+
+// Коллективное чтение (write = 0) или запись (write = 1) своего блока файла по всем процессам comm
+static void file_block_io(const char *path, int write, MPI_Comm comm, const elem_type *et, int N,
+                          int row0, int rows, int col0, int cols, void *buf) {
+    MPI_Offset expected = (MPI_Offset)N * N * (MPI_Offset)et->esize;
+    MPI_File fh;
+    int amode = write ? (MPI_MODE_WRONLY | MPI_MODE_CREATE) : MPI_MODE_RDONLY;
+    if (MPI_File_open(comm, path, amode, MPI_INFO_NULL, &fh) != MPI_SUCCESS) {
+        fprintf(stderr, "Ошибка: не удалось открыть файл %s\n", path);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    if (write) {
+        MPI_File_set_size(fh, expected); // обрезаем старый файл
+    } else {
+        MPI_Offset bytes;
+        MPI_File_get_size(fh, &bytes);
+        if (bytes != expected) {
+            fprintf(stderr, "Ошибка: размер %s (%lld байт) не соответствует матрице %dx%d %s\n",
+                    path, (long long)bytes, N, N, et->name);
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+    }
+    MPI_Datatype view = file_view(et->mpi_elem, N, row0, rows, col0, cols);
+    MPI_File_set_view(fh, 0, et->mpi_elem, view, "native", MPI_INFO_NULL);
+    if (write) MPI_File_write_all(fh, buf, rows * cols, et->mpi_elem, MPI_STATUS_IGNORE);
+    else MPI_File_read_all(fh, buf, rows * cols, et->mpi_elem, MPI_STATUS_IGNORE);
+    MPI_Type_free(&view);
+    MPI_File_close(&fh);
+}
+
+// Блок (row0, col0, rows x cols) матрицы which. Для INPUT_FILE вызов коллективный по comm.
+// Генератор дает целые в [-1000, 1000] (в int32 суммы переполнились бы уже при N > 2147,
+// накопление в int64 выдерживает любые реальные N) и float/double в [-1, 1).
+void load_block(const input_spec *in, const elem_type *et, int which, int N, MPI_Comm comm,
+                int row0, int rows, int col0, int cols, void *dst) {
+    if (in->kind == INPUT_FILE) {
+        file_block_io(in->path[which], 0, comm, et, N, row0, rows, col0, cols, dst);
+        return;
+    }
+    for (int i = 0; i < rows; i++) {
+        for (int j = 0; j < cols; j++) {
+            unsigned long long h = gen_bits(in, which, N, row0 + i, col0 + j);
+            size_t idx = (size_t)i * cols + j;
+            double v = (double)(h >> 11) * 0x1p-52 - 1.0;
+            if (et->id == ELEM_I32) ((int*)dst)[idx] = (int)(h % 2001) - 1000;
+            else if (et->id == ELEM_F32) ((float*)dst)[idx] = (float)v;
+            else ((double*)dst)[idx] = v;
+        }
+    }
+}
+
+// Вся матрица which целиком на одном процессе (для INPUT_ROOT и полной проверки)
+void *load_full(const input_spec *in, const elem_type *et, int which, int N) {
+    void *full = malloc((size_t)N * N * et->esize);
+    load_block(in, et, which, N, MPI_COMM_SELF, 0, N, 0, N, full);
+    return full;
+}
 
+// Сохранение блоков A и B в файлы PREFIX.A.bin и PREFIX.B.bin (для последующего --input=file)
+void save_blocks(const char *prefix, MPI_Comm comm, const elem_type *et, int N,
+                 int row0, int rows, int col0, int cols, void *loc_A, void *loc_B) {
+    char path[1024];
+    snprintf(path, sizeof(path), "%s.A.bin", prefix);
+    file_block_io(path, 1, comm, et, N, row0, rows, col0, cols, loc_A);
+    snprintf(path, sizeof(path), "%s.B.bin", prefix);
+    file_block_io(path, 1, comm, et, N, row0, rows, col0, cols, loc_B);
+}
+
+// --- Распределение блоков ---
+// Разбиение n строк (столбцов) на parts кусков: первые n % parts кусков длиннее на 1
+static int part_start(int n, int parts, int idx) { return idx * (n / parts) + imin(idx, n % parts); }
+static int part_len(int n, int parts, int idx) { return n / parts + (idx < n % parts); }
+
+// Номер куска, в который попадает индекс i
+static int part_owner(int n, int parts, int i) {
+    int idx = 0;
+    while (idx + 1 < parts && part_start(n, parts, idx + 1) <= i) idx++;
+    return idx;
+}
+
+// Число элементов в блоке процесса (r, c); при N < P или N < Q бывает 0
+static int block_count(int N, const int dims[2], int r, int c) {
+    return part_len(N, dims[0], r) * part_len(N, dims[1], c);
+}
+
+// Прямоугольник блока процесса (r, c) на решетке P x Q в матрице N x N как подмассив
+static MPI_Datatype block_subarray(MPI_Datatype type, int N, const int dims[2], int r, int c) {
+    int sizes[2] = {N, N};
+    int subsizes[2] = {part_len(N, dims[0], r), part_len(N, dims[1], c)};
+    int starts[2] = {part_start(N, dims[0], r), part_start(N, dims[1], c)};
+    MPI_Datatype t;
+    MPI_Type_create_subarray(2, sizes, subsizes, starts, MPI_ORDER_C, type, &t);
+    MPI_Type_commit(&t);
+    return t;
+}
+
+// Rank 0 раздает "рваные" блоки матрицы full (N x N элементов type) прямо из построчного хранения
+void scatter_ragged(int N, const int dims[2], MPI_Comm comm, MPI_Datatype type,
+                    const void *full, void *loc) {
     int rank, size;
-    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
-    MPI_Comm_size(MPI_COMM_WORLD, &size);
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+    int coords[2];
+    MPI_Cart_coords(comm, rank, 2, coords);
+    int count = block_count(N, dims, coords[0], coords[1]);
 
-    int dims[2] = {0, 0};
-    MPI_Dims_create(size, 2, dims);
-    if (dims[0] != dims[1]) {
-        if (rank == 0) fprintf(stderr, "Ошибка: P=%d должно быть квадратом (1, 4, 16...)\n", size);
-        MPI_Finalize();
-        return 1;
+    MPI_Request rreq = MPI_REQUEST_NULL;
+    if (count > 0) MPI_Irecv(loc, count, type, 0, 7, comm, &rreq);
+    if (rank == 0) {
+        for (int p = 0; p < size; p++) {
+            int pc[2];
+            MPI_Cart_coords(comm, p, 2, pc);
+            if (block_count(N, dims, pc[0], pc[1]) == 0) continue;
+            MPI_Datatype t = block_subarray(type, N, dims, pc[0], pc[1]);
+            MPI_Send(full, 1, t, p, 7, comm);
+            MPI_Type_free(&t);
+        }
     }
-    int sqrt_p = dims[0];
+    MPI_Wait(&rreq, MPI_STATUS_IGNORE);
+}
+
+// Обратная операция: rank 0 собирает блоки в построчную матрицу full
+void gather_ragged(int N, const int dims[2], MPI_Comm comm, MPI_Datatype type,
+                   const void *loc, void *full) {
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+    int coords[2];
+    MPI_Cart_coords(comm, rank, 2, coords);
+    int count = block_count(N, dims, coords[0], coords[1]);
 
-    int N;
+    MPI_Request sreq = MPI_REQUEST_NULL;
+    if (count > 0) MPI_Isend(loc, count, type, 0, 8, comm, &sreq);
     if (rank == 0) {
-        printf("Введите размер матриц N (для NxN): ");
-        fflush(stdout); // Важно: сброс буфера вывода
-        if (scanf("%d", &N) != 1) N = 0;
-        
-        if (N % sqrt_p != 0) {
-            fprintf(stderr, "Ошибка: N=%d должно делиться на sqrt(P)=%d.\n", N, sqrt_p);
-            MPI_Abort(MPI_COMM_WORLD, 1);
+        for (int p = 0; p < size; p++) {
+            int pc[2];
+            MPI_Cart_coords(comm, p, 2, pc);
+            if (block_count(N, dims, pc[0], pc[1]) == 0) continue;
+            MPI_Datatype t = block_subarray(type, N, dims, pc[0], pc[1]);
+            MPI_Recv(full, 1, t, p, 8, comm, MPI_STATUS_IGNORE);
+            MPI_Type_free(&t);
         }
     }
-    MPI_Bcast(&N, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    MPI_Wait(&sreq, MPI_STATUS_IGNORE);
+}
+
+// Тип "блок block_n x block_n внутри матрицы N x N по строкам", растянутый до block_n
+// элементов: тогда смещение блока (r, c) в Scatterv/Gatherv равно r * N + c
+static MPI_Datatype block_resized_type(MPI_Datatype type, int N, int block_n) {
+    MPI_Datatype vec, t;
+    MPI_Aint lb, extent;
+    MPI_Type_get_extent(type, &lb, &extent);
+    MPI_Type_vector(block_n, block_n, N, type, &vec);
+    MPI_Type_create_resized(vec, 0, (MPI_Aint)block_n * extent, &t);
+    MPI_Type_free(&vec);
+    MPI_Type_commit(&t);
+    return t;
+}
 
+// Раздача (gather = 0) или сбор (gather = 1) равных блоков Кэннона между full на rank 0
+// и loc на каждом процессе решетки - без промежуточной блочной копии матрицы
+void redistribute_blocks(int N, int sqrt_p, MPI_Comm comm, MPI_Datatype type, int gather,
+                         const void *full, void *loc) {
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
     int block_n = N / sqrt_p;
     int block_size = block_n * block_n;
 
-    int *A_serial = NULL, *B_serial = NULL, *C_serial = NULL;
-    int *A_blocked = NULL, *B_blocked = NULL, *C_blocked = NULL;
-    int *C_final = NULL;
-
+    MPI_Datatype block_t = block_resized_type(type, N, block_n);
+    int *counts = NULL, *displs = NULL;
     if (rank == 0) {
-        srand(time(NULL));
-
-        A_serial = (int*)malloc(N * N * sizeof(int));
-        B_serial = (int*)malloc(N * N * sizeof(int));
-        C_serial = (int*)malloc(N * N * sizeof(int));
-        
-        printf("Генерация матриц %dx%d...\n", N, N);
-        fflush(stdout);
-        
-        for (int i = 0; i < N * N; i++) {
-            A_serial[i] = rand() % 5; // Небольшие числа для теста
-            B_serial[i] = rand() % 5;
-        }
-
-        printf("Запуск последовательного алгоритма...\n");
-        fflush(stdout);
-        
-        double t_start = MPI_Wtime();
-        serial_multiply(N, A_serial, B_serial, C_serial);
-        double t_end = MPI_Wtime();
-        
-        printf("Время последовательного: %f сек.\n", t_end - t_start);
-        fflush(stdout);
-
-        A_blocked = (int*)malloc(N * N * sizeof(int));
-        B_blocked = (int*)malloc(N * N * sizeof(int));
-        C_blocked = (int*)malloc(N * N * sizeof(int));
-        
-        convert_to_blocks(A_serial, A_blocked, N, sqrt_p);
-        convert_to_blocks(B_serial, B_blocked, N, sqrt_p);
+        counts = (int*)malloc(size * sizeof(int));
+        displs = (int*)malloc(size * sizeof(int));
+        for (int p = 0; p < size; p++) {
+            int pc[2];
+            MPI_Cart_coords(comm, p, 2, pc);
+            counts[p] = 1;
+            displs[p] = pc[0] * N + pc[1];
+        }
     }
+    if (gather) MPI_Gatherv(loc, block_size, type, (void*)full, counts, displs, block_t, 0, comm);
+    else MPI_Scatterv(full, counts, displs, block_t, loc, block_size, type, 0, comm);
+
+    free(counts); free(displs);
+    MPI_Type_free(&block_t);
+}
+
+/*
+ * Бенчмарк раздачи/сбора (--bench-redist): reps раз раздаем A и собираем обратно
+ * двумя способами и сравниваем время на rank 0:
+ * 1) convert_to_blocks + MPI_Scatter, MPI_Gather + convert_from_blocks (промежуточная копия);
+ * 2) MPI_Scatterv / MPI_Gatherv с производным типом прямо из построчной матрицы.
+ */
+void bench_redistribution(int N, const int dims[2], const input_spec *in, int reps) {
+    int rank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    int sqrt_p = dims[0];
+    int block_n = N / sqrt_p;
+    int block_size = block_n * block_n;
 
     MPI_Comm grid_comm;
-    int periods[2] = {1, 1}; // Тор (замкнутая решетка)
-    MPI_Cart_create(MPI_COMM_WORLD, 2, dims, periods, 1, &grid_comm);
+    int periods[2] = {1, 1};
+    MPI_Cart_create(MPI_COMM_WORLD, 2, dims, periods, 0, &grid_comm);
 
-    int coords[2];
-    MPI_Cart_coords(grid_comm, rank, 2, coords);
+    // Сравнение способов раздачи не зависит от типа - берем int32, как convert_to_blocks
+    elem_type et;
+    elem_type_init("int32", &et);
+    int *full = NULL, *back = NULL;
+    if (rank == 0) {
+        full = (int*)load_full(in, &et, 0, N);
+        back = (int*)malloc((size_t)N * N * sizeof(int));
+    }
+    int *loc = (int*)malloc(block_size * sizeof(int));
 
-    int *loc_A = (int*)malloc(block_size * sizeof(int));
-    int *loc_B = (int*)malloc(block_size * sizeof(int));
-    int *loc_C = (int*)calloc(block_size, sizeof(int));
+    double t_path[2] = {0.0, 0.0};
+    int errors[2] = {0, 0};
+    for (int path = 0; path < 2; path++) {
+        for (int r = 0; r < reps; r++) {
+            if (rank == 0) memset(back, 0, (size_t)N * N * sizeof(int));
+            MPI_Barrier(grid_comm);
+            double t0 = MPI_Wtime();
+            if (path == 0) {
+                int *staging = (rank == 0) ? (int*)malloc((size_t)N * N * sizeof(int)) : NULL;
+                if (rank == 0) convert_to_blocks(full, staging, N, sqrt_p);
+                MPI_Scatter(staging, block_size, MPI_INT, loc, block_size, MPI_INT, 0, grid_comm);
+                MPI_Gather(loc, block_size, MPI_INT, staging, block_size, MPI_INT, 0, grid_comm);
+                if (rank == 0) convert_from_blocks(staging, back, N, sqrt_p);
+                free(staging);
+            } else {
+                redistribute_blocks(N, sqrt_p, grid_comm, MPI_INT, 0, full, loc);
+                redistribute_blocks(N, sqrt_p, grid_comm, MPI_INT, 1, back, loc);
+            }
+            MPI_Barrier(grid_comm);
+            t_path[path] += MPI_Wtime() - t0;
+            if (rank == 0 && memcmp(full, back, (size_t)N * N * sizeof(int)) != 0) errors[path]++;
+        }
+    }
 
-    MPI_Scatter(A_blocked, block_size, MPI_INT, loc_A, block_size, MPI_INT, 0, MPI_COMM_WORLD);
-    MPI_Scatter(B_blocked, block_size, MPI_INT, loc_B, block_size, MPI_INT, 0, MPI_COMM_WORLD);
+    if (rank == 0) {
+        printf("Раздача+сбор матрицы %dx%d на решетке %dx%d, %d повторов (среднее):\n",
+               N, N, sqrt_p, sqrt_p, reps);
+        printf("  convert_to_blocks + Scatter/Gather: %f сек.%s\n", t_path[0] / reps,
+               errors[0] ? " (ОШИБКА: данные не совпали)" : "");
+        printf("  Scatterv/Gatherv с типом-блоком:   %f сек.%s\n", t_path[1] / reps,
+               errors[1] ? " (ОШИБКА: данные не совпали)" : "");
+        if (t_path[1] > 0) printf("  Ускорение: %.2fx\n", t_path[0] / t_path[1]);
+    }
+
+    free(full); free(back); free(loc);
+    MPI_Comm_free(&grid_comm);
+}
+
+#define VERIFY_NONE      0 // без проверки
+#define VERIFY_FREIVALDS 1 // распределенная вероятностная проверка Фрейвалдса
+#define VERIFY_FULL      2 // сбор C на rank 0 и сверка с блочным многопоточным эталоном
+
+// Общие параметры запуска, которые передаются в run_cannon / run_summa
+typedef struct {
+    const elem_type *et;        // тип элементов (--type)
+    const input_spec *in;
+    const void *A_full, *B_full; // полные матрицы на rank 0 (только для INPUT_ROOT)
+    const char *save_prefix;    // --save-input=PREFIX или NULL
+    int overlap;                // Кэннон: сдвиги параллельно с умножением
+    int panel;                  // SUMMA: ширина панели
+    int verify;                 // VERIFY_*
+    int trials;                 // число попыток Фрейвалдса
+    int gather;                 // собрать C на rank 0
+} run_config;
+
+// Решетка процессов: создается один раз на весь запуск и служит всем размерам N
+typedef struct {
+    MPI_Comm comm;               // тор dims[0] x dims[1], ранги совпадают с MPI_COMM_WORLD
+    MPI_Comm row_comm, col_comm; // строка и столбец решетки (рассылки SUMMA)
+    int dims[2], coords[2];
+} proc_grid;
+
+void grid_create(const int dims[2], proc_grid *g) {
+    int rank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    // Без перенумерации; периодичность нужна сдвигам Кэннона, SUMMA ее не использует
+    int periods[2] = {1, 1};
+    MPI_Cart_create(MPI_COMM_WORLD, 2, dims, periods, 0, &g->comm);
+    MPI_Cart_coords(g->comm, rank, 2, g->coords);
+    int keep_cols[2] = {0, 1}, keep_rows[2] = {1, 0};
+    MPI_Cart_sub(g->comm, keep_cols, &g->row_comm); // процессы моей строки решетки
+    MPI_Cart_sub(g->comm, keep_rows, &g->col_comm); // процессы моего столбца решетки
+    g->dims[0] = dims[0];
+    g->dims[1] = dims[1];
+}
+
+void grid_free(proc_grid *g) {
+    MPI_Comm_free(&g->row_comm);
+    MPI_Comm_free(&g->col_comm);
+    MPI_Comm_free(&g->comm);
+}
+
+// Результат запуска на этом процессе
+typedef struct {
+    phase_stats st;
+    double t_par, t_load, t_verify;
+    int mismatches; // Фрейвалдс: попыток с расхождением (одинаково на всех процессах)
+    void *C;        // собранная C (тип накопления) на rank 0 при cfg->gather, иначе NULL
+} run_result;
+
+// Блоки A и B этого процесса: свой генератор/файл или раздача с rank 0 (INPUT_ROOT)
+static void load_inputs(int N, const int dims[2], MPI_Comm grid_comm, const run_config *cfg,
+                        int row0, int rows, int col0, int cols, void *loc_A, void *loc_B) {
+    const elem_type *et = cfg->et;
+    if (cfg->in->kind != INPUT_ROOT) {
+        load_block(cfg->in, et, 0, N, grid_comm, row0, rows, col0, cols, loc_A);
+        load_block(cfg->in, et, 1, N, grid_comm, row0, rows, col0, cols, loc_B);
+    } else if (dims[0] == dims[1] && N % dims[0] == 0) {
+        redistribute_blocks(N, dims[0], grid_comm, et->mpi_elem, 0, cfg->A_full, loc_A);
+        redistribute_blocks(N, dims[0], grid_comm, et->mpi_elem, 0, cfg->B_full, loc_B);
+    } else {
+        scatter_ragged(N, dims, grid_comm, et->mpi_elem, cfg->A_full, loc_A);
+        scatter_ragged(N, dims, grid_comm, et->mpi_elem, cfg->B_full, loc_B);
+    }
+}
+
+/*
+ * Проверка Фрейвалдса: для случайного x из {0,1}^N сравниваем A(Bx) и Cx.
+ * Если C != A*B, одна попытка замечает это с вероятностью >= 1/2, trials попыток -
+ * с вероятностью >= 1 - 2^-trials. Каждый процесс считает вклад своих блоков
+ * (O(N^2/P) на попытку), векторы длины N складываются MPI_Allreduce.
+ * Возвращает число попыток с расхождением (одинаково на всех процессах).
+ */
+
+// x одинаков на всех процессах: зависит только от seed, номера попытки и индекса
+static void freivalds_vector(unsigned long long seed, int t, int N, unsigned *x) {
+    for (int j = 0; j < N; j++) x[j] = (unsigned)(mix64(seed ^ 0xF4E1ULL, (unsigned long long)t * N + j) & 1);
+}
+
+// int32 с C в int64: арифметика по модулю 2^64, точное сравнение
+static int freivalds_i32(int N, MPI_Comm comm, unsigned long long seed, int trials,
+                         int row0, int rows, int col0, int cols,
+                         const int *A, const int *B, const long long *C) {
+    typedef unsigned long long u64;
+    unsigned *x = (unsigned*)malloc(N * sizeof(unsigned));
+    u64 *y = (u64*)malloc(N * sizeof(u64));
+    u64 *d = (u64*)malloc(N * sizeof(u64));
+    int failed = 0;
+
+    for (int t = 0; t < trials; t++) {
+        freivalds_vector(seed, t, N, x);
+
+        // y = B x
+        memset(y, 0, N * sizeof(u64));
+        for (int i = 0; i < rows; i++) {
+            u64 sum = 0;
+            for (int j = 0; j < cols; j++) sum += (u64)(long long)B[i * cols + j] * x[col0 + j];
+            y[row0 + i] += sum;
+        }
+        MPI_Allreduce(MPI_IN_PLACE, y, N, MPI_UNSIGNED_LONG_LONG, MPI_SUM, comm);
+
+        // d = A y - C x, должно быть нулевым
+        memset(d, 0, N * sizeof(u64));
+        for (int i = 0; i < rows; i++) {
+            u64 sum = 0;
+            for (int j = 0; j < cols; j++) {
+                sum += (u64)(long long)A[i * cols + j] * y[col0 + j] - (u64)C[i * cols + j] * x[col0 + j];
+            }
+            d[row0 + i] += sum;
+        }
+        MPI_Allreduce(MPI_IN_PLACE, d, N, MPI_UNSIGNED_LONG_LONG, MPI_SUM, comm);
+
+        for (int i = 0; i < N; i++) {
+            if (d[i] != 0) { failed++; break; }
+        }
+    }
+
+    free(x); free(y); free(d);
+    return failed;
+}
+
+/*
+ * float/double: считаем в double и сравниваем с ошибкой округления.
+ * Вместе с A(Bx) - Cx накапливается масштаб s = |A|(|B|x) + |C|x. Гарантированная граница
+ * N eps (|A||B|)_ij слишком груба (при N = 500 во float пропускает ошибки порядка
+ * самих элементов C), поэтому берется вероятностная: ошибки округления случайны по знаку
+ * и растут как sqrt(N) eps. Строка i неверна, если |d_i| > 4 sqrt(N) eps s_i.
+ */
+#define DEFINE_FREIVALDS_FP(T, S)                                                      \
+static int freivalds_##S(int N, MPI_Comm comm, unsigned long long seed, int trials,    \
+                         double eps, int row0, int rows, int col0, int cols,           \
+                         const T *A, const T *B, const T *C) {                         \
+    unsigned *x = (unsigned*)malloc(N * sizeof(unsigned));                             \
+    double *y = (double*)malloc(2 * N * sizeof(double)); /* B x и |B| x */             \
+    double *d = (double*)malloc(2 * N * sizeof(double)); /* A y - C x и масштаб */     \
+    double tol = 4.0 * sqrt((double)N) * eps;                                          \
+    int failed = 0;                                                                    \
+                                                                                       \
+    for (int t = 0; t < trials; t++) {                                                 \
+        freivalds_vector(seed, t, N, x);                                               \
+                                                                                       \
+        memset(y, 0, 2 * N * sizeof(double));                                          \
+        for (int i = 0; i < rows; i++) {                                               \
+            double sum = 0.0, sum_abs = 0.0;                                           \
+            for (int j = 0; j < cols; j++) {                                           \
+                double b = B[i * cols + j] * (double)x[col0 + j];                      \
+                sum += b;                                                              \
+                sum_abs += fabs(b);                                                    \
+            }                                                                          \
+            y[row0 + i] += sum;                                                        \
+            y[N + row0 + i] += sum_abs;                                                \
+        }                                                                              \
+        MPI_Allreduce(MPI_IN_PLACE, y, 2 * N, MPI_DOUBLE, MPI_SUM, comm);              \
+                                                                                       \
+        memset(d, 0, 2 * N * sizeof(double));                                          \
+        for (int i = 0; i < rows; i++) {                                               \
+            double sum = 0.0, scale = 0.0;                                             \
+            for (int j = 0; j < cols; j++) {                                           \
+                double a = A[i * cols + j], c = C[i * cols + j] * (double)x[col0 + j]; \
+                sum += a * y[col0 + j] - c;                                            \
+                scale += fabs(a) * y[N + col0 + j] + fabs(c);                          \
+            }                                                                          \
+            d[row0 + i] += sum;                                                        \
+            d[N + row0 + i] += scale;                                                  \
+        }                                                                              \
+        MPI_Allreduce(MPI_IN_PLACE, d, 2 * N, MPI_DOUBLE, MPI_SUM, comm);              \
+                                                                                       \
+        for (int i = 0; i < N; i++) {                                                  \
+            if (!(fabs(d[i]) <= tol * d[N + i])) { failed++; break; }                  \
+        }                                                                              \
+    }                                                                                  \
+                                                                                       \
+    free(x); free(y); free(d);                                                         \
+    return failed;                                                                     \
+}
+
+DEFINE_FREIVALDS_FP(float, f32)
+DEFINE_FREIVALDS_FP(double, f64)
+
+int freivalds_check(int N, MPI_Comm comm, const elem_type *et, unsigned long long seed, int trials,
+                    int row0, int rows, int col0, int cols,
+                    const void *A, const void *B, const void *C) {
+    if (et->id == ELEM_I32) {
+        return freivalds_i32(N, comm, seed, trials, row0, rows, col0, cols,
+                             (const int*)A, (const int*)B, (const long long*)C);
+    }
+    if (et->id == ELEM_F32) {
+        return freivalds_f32(N, comm, seed, trials, et->eps, row0, rows, col0, cols,
+                             (const float*)A, (const float*)B, (const float*)C);
+    }
+    return freivalds_f64(N, comm, seed, trials, et->eps, row0, rows, col0, cols,
+                         (const double*)A, (const double*)B, (const double*)C);
+}
+
+// Кэннон на квадратной решетке sqrt_p x sqrt_p (N делится на sqrt_p).
+// Блоки A и B процесс получает сам (генератор/файл) или от rank 0 (INPUT_ROOT).
+// Если cfg->gather, C возвращается в res->C на rank 0.
+void run_cannon(int N, const proc_grid *g, const run_config *cfg, run_result *res) {
+    int rank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    const elem_type *et = cfg->et;
+    const int *dims = g->dims, *coords = g->coords;
+    MPI_Comm grid_comm = g->comm;
+    int sqrt_p = dims[0];
+    int block_n = N / sqrt_p;
+    int block_size = block_n * block_n;
+
+    void *loc_A = malloc(block_size * et->esize);
+    void *loc_B = malloc(block_size * et->esize);
+    void *loc_C = calloc(block_size, et->csize);
+
+    int row0 = coords[0] * block_n, col0 = coords[1] * block_n;
+    double tl = MPI_Wtime();
+    load_inputs(N, dims, grid_comm, cfg, row0, block_n, col0, block_n, loc_A, loc_B);
+    res->t_load = MPI_Wtime() - tl;
+    if (cfg->save_prefix) save_blocks(cfg->save_prefix, grid_comm, et, N, row0, block_n, col0, block_n, loc_A, loc_B);
 
     // --- ПАРАЛЛЕЛЬНЫЙ АЛГОРИТМ (ИСПРАВЛЕННЫЙ) ---
     MPI_Barrier(MPI_COMM_WORLD);
@@ -157,66 +1172,577 @@ int main(int argc, char **argv) {
     // Сдвигаем A ВЛЕВО на i позиций (вдоль строки -> меняется измерение 1)
     if (coords[0] > 0) {
         MPI_Cart_shift(grid_comm, 1, -coords[0], &shift_src, &shift_dst);
-        MPI_Sendrecv_replace(loc_A, block_size, MPI_INT, shift_dst, 1, shift_src, 1, grid_comm, MPI_STATUS_IGNORE);
+        MPI_Sendrecv_replace(loc_A, block_size, et->mpi_elem, shift_dst, 1, shift_src, 1, grid_comm, MPI_STATUS_IGNORE);
     }
     
     // Сдвигаем B ВВЕРХ на j позиций (вдоль столбца -> меняется измерение 0)
     if (coords[1] > 0) {
         MPI_Cart_shift(grid_comm, 0, -coords[1], &shift_src, &shift_dst);
-        MPI_Sendrecv_replace(loc_B, block_size, MPI_INT, shift_dst, 1, shift_src, 1, grid_comm, MPI_STATUS_IGNORE);
+        MPI_Sendrecv_replace(loc_B, block_size, et->mpi_elem, shift_dst, 1, shift_src, 1, grid_comm, MPI_STATUS_IGNORE);
     }
 
     // 2. Основной цикл
-    int left, right, up, down;
-    // Соседи для A (влево/вправо) - измерение 1
-    MPI_Cart_shift(grid_comm, 1, -1, &right, &left); 
-    // Соседи для B (вверх/вниз) - измерение 0
-    MPI_Cart_shift(grid_comm, 0, -1, &down, &up);
+    phase_stats *st = &res->st;
+    if (cfg->overlap) cannon_loop_overlap(grid_comm, et, sqrt_p, block_n, &loc_A, &loc_B, loc_C, st);
+    else cannon_loop_blocking(grid_comm, et, sqrt_p, block_n, loc_A, loc_B, loc_C, st);
 
-    for (int k = 0; k < sqrt_p; k++) {
-        // Умножаем
-        matrix_multiply_add(block_n, loc_A, loc_B, loc_C);
+    MPI_Barrier(MPI_COMM_WORLD);
+    res->t_par = MPI_Wtime() - para_start;
 
-        // Сдвигаем A влево, B вверх
-        MPI_Sendrecv_replace(loc_A, block_size, MPI_INT, left, 1, right, 1, grid_comm, MPI_STATUS_IGNORE);
-        MPI_Sendrecv_replace(loc_B, block_size, MPI_INT, up, 2, down, 2, grid_comm, MPI_STATUS_IGNORE);
+    if (cfg->verify == VERIFY_FREIVALDS) {
+        // Блоки A и B после сдвигов стоят не на своих местах - берем исходные заново
+        double tv = MPI_Wtime();
+        load_inputs(N, dims, grid_comm, cfg, row0, block_n, col0, block_n, loc_A, loc_B);
+        res->mismatches = freivalds_check(N, grid_comm, et, cfg->in->seed, cfg->trials,
+                                          row0, block_n, col0, block_n, loc_A, loc_B, loc_C);
+        res->t_verify = MPI_Wtime() - tv;
+    }
+
+    res->C = NULL;
+    if (cfg->gather) {
+        if (rank == 0) res->C = malloc((size_t)N * N * et->csize);
+        redistribute_blocks(N, sqrt_p, grid_comm, et->mpi_acc, 1, res->C, loc_C);
+    }
+
+    free(loc_A); free(loc_B); free(loc_C);
+}
+
+// Панель SUMMA: столбцы [k0, k1) матрицы A и те же строки матрицы B
+typedef struct {
+    int k0, k1;
+    int a_root; // столбец решетки, владеющий столбцами A
+    int b_root; // строка решетки, владеющая строками B
+} summa_panel;
+
+/*
+ * SUMMA на произвольной решетке P x Q (dims из MPI_Dims_create) и любом N.
+ * Блоки A и B загружаются и проверяются как в run_cannon, C собирается на rank 0 при cfg->gather.
+ * Блоки "рваные": строки делятся на P кусков, столбцы на Q кусков (part_start/part_len).
+ * На шаге t владелец столбцов панели рассылает кусок A вдоль строки решетки,
+ * владелец строк - кусок B вдоль столбца (MPI_Ibcast по подкоммуникаторам).
+ * Рассылка панели t+1 идет, пока считается панель t (двойная буферизация).
+ * Ширина панели - не больше nb и не пересекает границы блоков.
+ */
+void run_summa(int N, const proc_grid *g, const run_config *cfg, run_result *res) {
+    int rank;
+    int nb = cfg->panel;
+    phase_stats *st = &res->st;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    const elem_type *et = cfg->et;
+    size_t es = et->esize;
+    const int *dims = g->dims, *coords = g->coords;
+    MPI_Comm grid_comm = g->comm, row_comm = g->row_comm, col_comm = g->col_comm;
+
+    int my_rows = part_len(N, dims[0], coords[0]), row0 = part_start(N, dims[0], coords[0]);
+    int my_cols = part_len(N, dims[1], coords[1]), col0 = part_start(N, dims[1], coords[1]);
+
+    char *loc_A = (char*)malloc((size_t)my_rows * my_cols * es);
+    char *loc_B = (char*)malloc((size_t)my_rows * my_cols * es);
+    void *loc_C = calloc((size_t)my_rows * my_cols, et->csize);
+    double tl = MPI_Wtime();
+    load_inputs(N, dims, grid_comm, cfg, row0, my_rows, col0, my_cols, loc_A, loc_B);
+    res->t_load = MPI_Wtime() - tl;
+    if (cfg->save_prefix) save_blocks(cfg->save_prefix, grid_comm, et, N, row0, my_rows, col0, my_cols, loc_A, loc_B);
+
+    // Разбиение k на панели по общим границам блоков A (по столбцам) и B (по строкам)
+    int npanels = 0;
+    summa_panel *panels = (summa_panel*)malloc((N + 1) * sizeof(summa_panel));
+    for (int k0 = 0; k0 < N; ) {
+        summa_panel *pn = &panels[npanels++];
+        pn->k0 = k0;
+        pn->a_root = part_owner(N, dims[1], k0);
+        pn->b_root = part_owner(N, dims[0], k0);
+        int end = k0 + nb;
+        end = imin(end, part_start(N, dims[1], pn->a_root) + part_len(N, dims[1], pn->a_root));
+        end = imin(end, part_start(N, dims[0], pn->b_root) + part_len(N, dims[0], pn->b_root));
+        pn->k1 = end;
+        k0 = end;
     }
 
+    void *bufA[2], *bufB[2];
+    for (int i = 0; i < 2; i++) {
+        bufA[i] = malloc((size_t)my_rows * nb * es);
+        bufB[i] = malloc((size_t)nb * my_cols * es);
+    }
+
+    MPI_Request reqs[2][2];
+    MPI_Datatype a_type[2] = {MPI_DATATYPE_NULL, MPI_DATATYPE_NULL};
+
     MPI_Barrier(MPI_COMM_WORLD);
-    double para_end = MPI_Wtime();
+    double para_start = MPI_Wtime();
 
-    MPI_Gather(loc_C, block_size, MPI_INT, C_blocked, block_size, MPI_INT, 0, MPI_COMM_WORLD);
+    // Куски панели внутри своих блоков: столбцы [k0, ...) блока A и строки [k0, ...) блока B
+    #define A_PANEL(pp) (loc_A + (size_t)((pp)->k0 - col0) * es)
+    #define B_PANEL(pp) (loc_B + (size_t)((pp)->k0 - row0) * my_cols * es)
 
-    if (rank == 0) {
-        printf("Время параллельного (MPI Cannon): %f сек.\n", para_end - para_start);
-        fflush(stdout);
+    // Запуск рассылки панели t в буферы t % 2. Владелец шлет прямо из своего блока:
+    // кусок A - страйдовый (вектор), кусок B - подряд идущие строки.
+    #define SUMMA_POST(t) do {                                                              \
+        const summa_panel *pp = &panels[(t)];                                               \
+        int kb = pp->k1 - pp->k0, slot = (t) % 2;                                           \
+        if (coords[1] == pp->a_root) {                                                      \
+            MPI_Type_vector(my_rows, kb, my_cols, et->mpi_elem, &a_type[slot]);             \
+            MPI_Type_commit(&a_type[slot]);                                                 \
+            MPI_Ibcast(A_PANEL(pp), my_rows ? 1 : 0, a_type[slot], pp->a_root,              \
+                       row_comm, &reqs[slot][0]);                                           \
+        } else {                                                                            \
+            MPI_Ibcast(bufA[slot], my_rows * kb, et->mpi_elem, pp->a_root, row_comm,        \
+                       &reqs[slot][0]);                                                     \
+        }                                                                                   \
+        void *bsrc = (coords[0] == pp->b_root) ? (void*)B_PANEL(pp) : bufB[slot];           \
+        MPI_Ibcast(bsrc, kb * my_cols, et->mpi_elem, pp->b_root, col_comm, &reqs[slot][1]); \
+    } while (0)
+
+    double t0 = MPI_Wtime();
+    SUMMA_POST(0);
+    st->comm_wait += MPI_Wtime() - t0;
+
+    for (int t = 0; t < npanels; t++) {
+        const summa_panel *pn = &panels[t];
+        int kb = pn->k1 - pn->k0, slot = t % 2;
+
+        t0 = MPI_Wtime();
+        MPI_Waitall(2, reqs[slot], MPI_STATUSES_IGNORE);
+        if (a_type[slot] != MPI_DATATYPE_NULL) MPI_Type_free(&a_type[slot]);
+        if (t + 1 < npanels) SUMMA_POST(t + 1);
+        double t1 = MPI_Wtime();
+
+        const void *pa = (coords[1] == pn->a_root) ? (void*)A_PANEL(pn) : bufA[slot];
+        int lda = (coords[1] == pn->a_root) ? my_cols : kb;
+        const void *pb = (coords[0] == pn->b_root) ? (void*)B_PANEL(pn) : bufB[slot];
+        et->gemm(my_rows, my_cols, kb, pa, lda, pb, my_cols, loc_C, my_cols);
+
+        st->comm_wait += t1 - t0;
+        st->compute += MPI_Wtime() - t1;
+    }
+    #undef SUMMA_POST
+    #undef A_PANEL
+    #undef B_PANEL
 
-        C_final = (int*)malloc(N * N * sizeof(int));
-        convert_from_blocks(C_blocked, C_final, N, sqrt_p);
+    MPI_Barrier(MPI_COMM_WORLD);
+    res->t_par = MPI_Wtime() - para_start;
+
+    // Блоки A и B SUMMA не меняет - проверяем прямо на них
+    if (cfg->verify == VERIFY_FREIVALDS) {
+        double tv = MPI_Wtime();
+        res->mismatches = freivalds_check(N, grid_comm, et, cfg->in->seed, cfg->trials,
+                                          row0, my_rows, col0, my_cols, loc_A, loc_B, loc_C);
+        res->t_verify = MPI_Wtime() - tv;
+    }
 
-        int errors = 0;
-        for (int i = 0; i < N * N; i++) {
-            if (C_serial[i] != C_final[i]) errors++;
+    res->C = NULL;
+    if (cfg->gather) {
+        if (rank == 0) res->C = malloc((size_t)N * N * et->csize);
+        gather_ragged(N, dims, grid_comm, et->mpi_acc, loc_C, res->C);
+    }
+
+    for (int i = 0; i < 2; i++) { free(bufA[i]); free(bufB[i]); }
+    free(panels);
+    free(loc_A); free(loc_B); free(loc_C);
+}
+
+// Элемент i массива как double: A/B (acc = 0) или C в типе накопления (acc = 1)
+static double elem_value(const elem_type *et, int acc, const void *p, size_t i) {
+    if (et->id == ELEM_I32) return acc ? (double)((const long long*)p)[i] : ((const int*)p)[i];
+    if (et->id == ELEM_F32) return ((const float*)p)[i];
+    return ((const double*)p)[i];
+}
+
+// Полная проверка на rank 0: число элементов C, не совпавших с эталоном R.
+// Целые сравниваются точно, float/double - с допуском 8 sqrt(N) eps * N max|A| max|B|
+// (вероятностная ошибка округления C и R, как в проверке Фрейвалдса, при (|A||B|)_ij <= N max|A| max|B|).
+long long count_mismatches(const elem_type *et, int N, const void *A, const void *B,
+                           const void *R, const void *C) {
+    size_t total = (size_t)N * N;
+    long long errors = 0;
+    if (et->id == ELEM_I32) {
+        const long long *r = (const long long*)R, *c = (const long long*)C;
+        for (size_t i = 0; i < total; i++) errors += (r[i] != c[i]);
+        return errors;
+    }
+    double amax = 0.0, bmax = 0.0;
+    for (size_t i = 0; i < total; i++) {
+        amax = fmax(amax, fabs(elem_value(et, 0, A, i)));
+        bmax = fmax(bmax, fabs(elem_value(et, 0, B, i)));
+    }
+    double tol = 8.0 * sqrt((double)N) * et->eps * N * amax * bmax;
+    for (size_t i = 0; i < total; i++) {
+        if (!(fabs(elem_value(et, 1, C, i) - elem_value(et, 1, R, i)) <= tol)) errors++;
+    }
+    return errors;
+}
+
+// --- Серия замеров и машиночитаемый вывод ---
+
+// Разбор списка размеров "N1,N2,...": число размеров или -1 при ошибке
+static int parse_sizes(const char *s, int **out) {
+    int cap = 1;
+    for (const char *p = s; *p; p++) cap += (*p == ',');
+    int *sizes = (int*)malloc(cap * sizeof(int));
+    int n = 0;
+    while (*s) {
+        char *end;
+        long v = strtol(s, &end, 10);
+        if (end == s || v < 1 || v > 1000000 || (*end != ',' && *end != '\0')) { free(sizes); return -1; }
+        sizes[n++] = (int)v;
+        s = (*end == ',') ? end + 1 : end;
+    }
+    *out = sizes;
+    return n;
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+// Одна строка результатов: один размер N в одном запуске
+typedef struct {
+    const char *algo, *type, *kernel, *isa, *verify;
+    int procs, dims[2], threads;
+    int overlap;                        // 1 - обмен перекрыт со счетом (Кэннон с --overlap; SUMMA - всегда)
+    int N, reps, warmup;
+    double t_min, t_med, t_mean, t_max; // время умножения по повторам
+    double compute, comm_wait;          // средние по повторам, максимум по процессам
+    double gops;                        // GOP/s на процесс по compute
+    double t_load, t_verify;
+    int ok;                             // 1 - верно, 0 - ошибка, -1 - не проверялось
+} bench_record;
+
+// CSV дописывается в конец файла: несколько запусков (разные P) копятся в одном файле,
+// заголовок пишется только в пустой файл
+static void write_csv(const char *path, const bench_record *r) {
+    FILE *f = fopen(path, "a");
+    if (!f) { fprintf(stderr, "Ошибка: не удалось открыть %s\n", path); return; }
+    fseek(f, 0, SEEK_END);
+    if (ftell(f) == 0) {
+        fprintf(f, "algo,type,kernel,isa,overlap,procs,grid_p,grid_q,threads,n,reps,warmup,"
+                   "t_min,t_median,t_mean,t_max,compute,comm_wait,gops,t_load,verify,t_verify,ok\n");
+    }
+    fprintf(f, "%s,%s,%s,%s,%d,%d,%d,%d,%d,%d,%d,%d,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f,%.3f,%.6f,%s,%.6f,%d\n",
+            r->algo, r->type, r->kernel, r->isa, r->overlap, r->procs, r->dims[0], r->dims[1], r->threads,
+            r->N, r->reps, r->warmup, r->t_min, r->t_med, r->t_mean, r->t_max,
+            r->compute, r->comm_wait, r->gops, r->t_load, r->verify, r->t_verify, r->ok);
+    fclose(f);
+}
+
+// JSON Lines: по одному объекту на строку, тоже дописывается в конец
+static void write_json(const char *path, const bench_record *r) {
+    FILE *f = fopen(path, "a");
+    if (!f) { fprintf(stderr, "Ошибка: не удалось открыть %s\n", path); return; }
+    fprintf(f, "{\"algo\": \"%s\", \"type\": \"%s\", \"kernel\": \"%s\", \"isa\": \"%s\", \"overlap\": %d, "
+               "\"procs\": %d, \"grid\": [%d, %d], \"threads\": %d, \"n\": %d, \"reps\": %d, \"warmup\": %d, "
+               "\"t_min\": %.6f, \"t_median\": %.6f, \"t_mean\": %.6f, \"t_max\": %.6f, "
+               "\"compute\": %.6f, \"comm_wait\": %.6f, \"gops\": %.3f, \"t_load\": %.6f, "
+               "\"verify\": \"%s\", \"t_verify\": %.6f, \"ok\": %d}\n",
+            r->algo, r->type, r->kernel, r->isa, r->overlap, r->procs, r->dims[0], r->dims[1], r->threads,
+            r->N, r->reps, r->warmup, r->t_min, r->t_med, r->t_mean, r->t_max,
+            r->compute, r->comm_wait, r->gops, r->t_load, r->verify, r->t_verify, r->ok);
+    fclose(f);
+}
+
+int main(int argc, char **argv) {
+    // Гибридный режим: MPI вызывает только главный поток, умножение блока делят потоки OpenMP
+    int provided;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
+
+    int rank, size;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+    int threads = 1; // Потоков на процесс: --threads=T, по умолчанию OMP_NUM_THREADS
+#ifdef _OPENMP
+    threads = omp_get_max_threads();
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--threads=", 10) == 0) threads = atoi(argv[i] + 10);
+    }
+    if (threads < 1) threads = 1;
+    if (provided < MPI_THREAD_FUNNELED && threads > 1) {
+        if (rank == 0) fprintf(stderr, "Предупреждение: MPI не поддерживает MPI_THREAD_FUNNELED, работаем в 1 поток\n");
+        threads = 1;
+    }
+    omp_set_num_threads(threads);
+#endif
+
+    if (parse_kernel_flags(argc, argv) != 0) {
+        if (rank == 0) fprintf(stderr, "Ошибка: ожидается --kernel=naive|blocked и --isa=scalar|avx2|avx512 (поддерживаемый процессором)\n");
+        MPI_Finalize();
+        return 1;
+    }
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--selftest") != 0) continue;
+        int status = (rank == 0) ? run_selftest() : 0;
+        MPI_Bcast(&status, 1, MPI_INT, 0, MPI_COMM_WORLD);
+        MPI_Finalize();
+        return status;
+    }
+
+    int overlap = 0;  // --overlap: сдвиги идут параллельно с умножением
+    int summa = 0;    // --algo=summa: SUMMA вместо Кэннона
+    int panel = 256;  // --panel=NB: ширина панели SUMMA
+    int verify = VERIFY_FREIVALDS; // --verify=none|freivalds|full
+    int trials = 10;  // --trials=K: попыток Фрейвалдса
+    input_spec in = {INPUT_GEN, 0, {NULL, NULL}};
+    int have_seed = 0;
+    const char *save_prefix = NULL;
+    int bench_redist = 0; // --bench-redist: сравнить способы раздачи блоков и выйти
+    int nsizes = 0, *sizes = NULL; // --n=N или --sizes=N1,N2,...: без них N вводится с клавиатуры
+    int reps = 1, warmup = 0;      // --reps=R замеров и --warmup=W прогревочных запусков на размер
+    const char *type_name = "int32"; // --type=int32|float|double: тип элементов
+    const char *csv_path = NULL, *json_path = NULL; // --csv=FILE, --json=FILE: дописать результаты
+    int bad_arg = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--overlap") == 0) overlap = 1;
+        else if (strcmp(argv[i], "--algo=summa") == 0) summa = 1;
+        else if (strcmp(argv[i], "--algo=cannon") == 0) summa = 0;
+        else if (strncmp(argv[i], "--panel=", 8) == 0) panel = atoi(argv[i] + 8);
+        else if (strcmp(argv[i], "--verify=none") == 0) verify = VERIFY_NONE;
+        else if (strcmp(argv[i], "--verify=freivalds") == 0) verify = VERIFY_FREIVALDS;
+        else if (strcmp(argv[i], "--verify=full") == 0) verify = VERIFY_FULL;
+        else if (strncmp(argv[i], "--trials=", 9) == 0) trials = atoi(argv[i] + 9);
+        else if (strcmp(argv[i], "--input=gen") == 0) in.kind = INPUT_GEN;
+        else if (strcmp(argv[i], "--input=root") == 0) in.kind = INPUT_ROOT;
+        else if (strcmp(argv[i], "--input=file") == 0) in.kind = INPUT_FILE;
+        else if (strncmp(argv[i], "--file-a=", 9) == 0) in.path[0] = argv[i] + 9;
+        else if (strncmp(argv[i], "--file-b=", 9) == 0) in.path[1] = argv[i] + 9;
+        else if (strncmp(argv[i], "--seed=", 7) == 0) { in.seed = strtoull(argv[i] + 7, NULL, 10); have_seed = 1; }
+        else if (strncmp(argv[i], "--save-input=", 13) == 0) save_prefix = argv[i] + 13;
+        else if (strcmp(argv[i], "--bench-redist") == 0) bench_redist = 1;
+        else if (strncmp(argv[i], "--n=", 4) == 0 || strncmp(argv[i], "--sizes=", 8) == 0) {
+            free(sizes);
+            nsizes = parse_sizes(strchr(argv[i], '=') + 1, &sizes);
+            if (nsizes <= 0) { sizes = NULL; nsizes = 0; bad_arg = 1; }
         }
+        else if (strncmp(argv[i], "--reps=", 7) == 0) reps = atoi(argv[i] + 7);
+        else if (strncmp(argv[i], "--warmup=", 9) == 0) warmup = atoi(argv[i] + 9);
+        else if (strncmp(argv[i], "--type=", 7) == 0) type_name = argv[i] + 7;
+        else if (strncmp(argv[i], "--csv=", 6) == 0) csv_path = argv[i] + 6;
+        else if (strncmp(argv[i], "--json=", 7) == 0) json_path = argv[i] + 7;
+    }
+    if (bad_arg) {
+        if (rank == 0) fprintf(stderr, "Ошибка: ожидается --n=N или --sizes=N1,N2,... с положительными N\n");
+        MPI_Finalize();
+        return 1;
+    }
+    elem_type et;
+    if (elem_type_init(type_name, &et) != 0) {
+        if (rank == 0) fprintf(stderr, "Ошибка: --type=%s не поддерживается (int32, float, double)\n", type_name);
+        MPI_Finalize();
+        return 1;
+    }
+    if (in.kind == INPUT_FILE && (!in.path[0] || !in.path[1])) {
+        if (rank == 0) fprintf(stderr, "Ошибка: --input=file требует --file-a=PATH и --file-b=PATH\n");
+        MPI_Finalize();
+        return 1;
+    }
+    if (save_prefix && nsizes > 1) {
+        if (rank == 0) fprintf(stderr, "Ошибка: --save-input пишет матрицы одного размера, а задано %d\n", nsizes);
+        MPI_Finalize();
+        return 1;
+    }
+    // Зерно генератора одно на все процессы
+    if (!have_seed && rank == 0) in.seed = (unsigned long long)time(NULL);
+    MPI_Bcast(&in.seed, 1, MPI_UNSIGNED_LONG_LONG, 0, MPI_COMM_WORLD);
+    if (panel < 1) panel = 1;
+    if (trials < 1) trials = 1;
+    if (reps < 1) reps = 1;
+    if (warmup < 0) warmup = 0;
 
-        if (errors == 0) printf(">> Результат ВЕРНЫЙ.\n");
-        else printf(">> ОШИБКА: %d несовпадений!\n", errors);
+    // Кэннону нужна квадратная решетка, SUMMA берет любую P x Q
+    int dims[2] = {0, 0};
+    MPI_Dims_create(size, 2, dims);
+    if (!summa && dims[0] != dims[1]) {
+        if (rank == 0) fprintf(stderr, "Ошибка: P=%d должно быть квадратом (1, 4, 16...), либо используйте --algo=summa\n", size);
+        MPI_Finalize();
+        return 1;
+    }
+    int sqrt_p = dims[0];
 
-        // Для отладки (если N маленькое)
-        if (N <= 8) {
-             printf("\nMatrix C (Parallel):\n");
-             for(int i=0; i<N; i++) {
-                 for(int j=0; j<N; j++) printf("%d ", C_final[i*N+j]);
-                 printf("\n");
-             }
+    if (nsizes == 0) {
+        int N;
+        if (rank == 0) {
+            printf("Введите размер матриц N (для NxN): ");
+            fflush(stdout); // Важно: сброс буфера вывода
+            if (scanf("%d", &N) != 1) N = 0;
+        }
+        MPI_Bcast(&N, 1, MPI_INT, 0, MPI_COMM_WORLD);
+        if (N < 1) {
+            if (rank == 0) fprintf(stderr, "Ошибка: N должно быть положительным\n");
+            MPI_Finalize();
+            return 1;
         }
+        nsizes = 1;
+        sizes = (int*)malloc(sizeof(int));
+        sizes[0] = N;
+    }
+    // Размеры известны всем процессам одинаково, поэтому проверка и выход согласованы
+    for (int s = 0; s < nsizes; s++) {
+        if (!summa && sizes[s] % sqrt_p != 0) {
+            if (rank == 0) fprintf(stderr, "Ошибка: N=%d должно делиться на sqrt(P)=%d.\n", sizes[s], sqrt_p);
+            MPI_Finalize();
+            return 1;
+        }
+    }
 
-        free(A_serial); free(B_serial); free(C_serial);
-        free(A_blocked); free(B_blocked); free(C_blocked);
-        free(C_final);
+    if (bench_redist) {
+        if (!summa) bench_redistribution(sizes[0], dims, &in, 5);
+        else if (rank == 0) fprintf(stderr, "Ошибка: --bench-redist сравнивает раздачу блоков Кэннона\n");
+        free(sizes);
+        MPI_Finalize();
+        return 0;
     }
 
-    free(loc_A); free(loc_B); free(loc_C);
+    // Одна решетка на все размеры серии
+    proc_grid grid;
+    grid_create(dims, &grid);
+    double *t_rep = (double*)malloc(reps * sizeof(double));
+
+    for (int s = 0; s < nsizes; s++) {
+        int N = sizes[s];
+
+        // Полные матрицы есть только на rank 0 и только если они нужны: для старой раздачи
+        // с корня или для полной проверки. Иначе память каждого процесса - O(N^2 / P).
+        void *A_serial = NULL, *B_serial = NULL, *C_serial = NULL;
+
+        if (rank == 0 && nsizes > 1) {
+            printf("\n=== N = %d (%d из %d) ===\n", N, s + 1, nsizes);
+            fflush(stdout);
+        }
+
+        if (rank == 0 && (verify == VERIFY_FULL || in.kind == INPUT_ROOT)) {
+            printf("Построение полных матриц %dx%d на rank 0...\n", N, N);
+            fflush(stdout);
+            A_serial = load_full(&in, &et, 0, N);
+            B_serial = load_full(&in, &et, 1, N);
+        }
+
+        if (rank == 0 && verify == VERIFY_FULL) {
+            C_serial = calloc((size_t)N * N, et.csize);
+
+            printf("Запуск эталона (наивное ядро, %d потоков)...\n", threads);
+            fflush(stdout);
+
+            double t_start = MPI_Wtime();
+            et.gemm_ref(N, N, N, A_serial, N, B_serial, N, C_serial, N);
+            double t_end = MPI_Wtime();
+
+            printf("Время эталона: %f сек.\n", t_end - t_start);
+            fflush(stdout);
+        }
+
+        // Прогрев (r < 0) не входит в статистику. Проверка, сбор C и сохранение входа -
+        // только в последнем повторе, чтобы не искажать время остальных.
+        run_result res;
+        phase_stats st = {0.0, 0.0, 0.0};
+        // Оценка сдвигов без перекрытия - отдельным шагом до замеров, в t_par не входит
+        if (overlap && !summa) st.comm_est = cannon_shift_estimate(grid.comm, &et, dims[0], N / dims[0]);
+        for (int r = -warmup; r < reps; r++) {
+            int last = (r == reps - 1);
+            run_config cfg = {&et, &in, A_serial, B_serial, last ? save_prefix : NULL, overlap, panel,
+                              last ? verify : VERIFY_NONE, trials,
+                              last && (verify == VERIFY_FULL || N <= 8)};
+            memset(&res, 0, sizeof(res));
+            if (summa) run_summa(N, &grid, &cfg, &res);
+            else run_cannon(N, &grid, &cfg, &res);
+            if (r < 0) continue;
+            t_rep[r] = res.t_par;
+            st.compute += res.st.compute / reps;
+            st.comm_wait += res.st.comm_wait / reps;
+        }
+        void *C_final = res.C;
+
+        double t_io_max[2], t_io[2] = {res.t_load, res.t_verify};
+        MPI_Reduce(t_io, t_io_max, 2, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+        double t_load_max = t_io_max[0];
+
+        // Максимум по процессам: самый медленный процесс определяет время шага
+        phase_stats st_max;
+        MPI_Reduce(&st, &st_max, 3, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+
+        if (rank == 0) {
+            qsort(t_rep, reps, sizeof(double), cmp_double);
+            double t_mean = 0.0;
+            for (int r = 0; r < reps; r++) t_mean += t_rep[r] / reps;
+            double t_med = (reps % 2) ? t_rep[reps / 2] : 0.5 * (t_rep[reps / 2 - 1] + t_rep[reps / 2]);
+            double t_par = t_rep[0];
+
+            static const char *input_names[] = {"генератор на каждом процессе", "MPI-IO", "раздача с rank 0"};
+            printf("Загрузка блоков (%s): %f сек.\n", input_names[in.kind], t_load_max);
+            if (summa) {
+                printf("Время параллельного (MPI SUMMA, решетка %dx%d, панель %d, %d потоков): %f сек.\n",
+                       dims[0], dims[1], panel, threads, t_par);
+            } else {
+                printf("Время параллельного (MPI Cannon, %d процессов x %d потоков): %f сек.\n",
+                       size, threads, t_par);
+            }
+            if (reps > 1) {
+                printf("  (лучшее из %d повторов после %d прогревочных; медиана %f, среднее %f, худшее %f сек.)\n",
+                       reps, warmup, t_med, t_mean, t_rep[reps - 1]);
+            }
+            // 2*N^3 операций на всю матрицу, делятся поровну между процессами
+            double ops = 2.0 * N * N * (double)N / size;
+            double gops = st_max.compute > 0 ? ops / st_max.compute * 1e-9 : 0.0;
+            printf("Локальное умножение (%s, %s, %s): %f сек., %.2f GOP/s на процесс\n", et.name,
+                   kernel_kind == KERNEL_BLOCKED ? "blocked" : "naive", isa_names[gemm_kernel_i32.isa],
+                   st_max.compute, gops);
+            if (overlap && !summa) {
+                double hidden = st_max.comm_est - st_max.comm_wait;
+                if (hidden < 0) hidden = 0;
+                printf("Обмен (--overlap): ожидание %f сек., оценка сдвигов без перекрытия %f сек., скрыто %f сек. (%.0f%%)\n",
+                       st_max.comm_wait, st_max.comm_est, hidden,
+                       st_max.comm_est > 0 ? 100.0 * hidden / st_max.comm_est : 0.0);
+            } else {
+                printf("Обмен (%s): %f сек.\n", summa ? "ожидание панелей" : "блокирующий", st_max.comm_wait);
+            }
+            fflush(stdout);
+
+            int ok = -1;
+            if (verify == VERIFY_FULL) {
+                long long errors = count_mismatches(&et, N, A_serial, B_serial, C_serial, C_final);
+                ok = (errors == 0);
+
+                if (errors == 0) printf(">> Результат ВЕРНЫЙ.\n");
+                else printf(">> ОШИБКА: %lld несовпадений!\n", errors);
+            } else if (verify == VERIFY_FREIVALDS) {
+                ok = (res.mismatches == 0);
+                printf("Проверка Фрейвалдса (%d попыток): %f сек.\n", trials, t_io_max[1]);
+                if (res.mismatches == 0) printf(">> Результат ВЕРНЫЙ (вероятность пропустить ошибку%s <= 2^-%d).\n",
+                                                et.eps ? " сверх допуска округления" : "", trials);
+                else printf(">> ОШИБКА: расхождение в %d из %d попыток!\n", res.mismatches, trials);
+            } else {
+                printf(">> Проверка отключена (--verify=none).\n");
+            }
+
+            // Для отладки (если N маленькое)
+            if (N <= 8) {
+                 printf("\nMatrix C (Parallel):\n");
+                 for(int i=0; i<N; i++) {
+                     for(int j=0; j<N; j++) printf(et.eps ? "%.4f " : "%.0f ", elem_value(&et, 1, C_final, i*N+j));
+                     printf("\n");
+                 }
+            }
+            fflush(stdout);
+
+            static const char *verify_names[] = {"none", "freivalds", "full"};
+            bench_record rec = {summa ? "summa" : "cannon", et.name,
+                                kernel_kind == KERNEL_BLOCKED ? "blocked" : "naive",
+                                isa_names[gemm_kernel_i32.isa], verify_names[verify],
+                                size, {dims[0], dims[1]}, threads, summa || overlap, N, reps, warmup,
+                                t_par, t_med, t_mean, t_rep[reps - 1],
+                                st_max.compute, st_max.comm_wait, gops, t_load_max, t_io_max[1], ok};
+            if (csv_path) write_csv(csv_path, &rec);
+            if (json_path) write_json(json_path, &rec);
+
+            free(A_serial); free(B_serial); free(C_serial);
+            free(C_final);
+        }
+    }
+
+    free(t_rep);
+    free(sizes);
+    grid_free(&grid);
     MPI_Finalize();
     return 0;
 }